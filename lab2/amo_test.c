@@ -0,0 +1,160 @@
+/*
+ * SP ASM: Atomic Fetch-and-Add / Compare-and-Swap Test
+ *
+ * Runs on the ISS, the multicycle core and the lab3_A pipelined core with
+ * any number of cores (SP_NR_CORES). Every core:
+ *   1) bumps the shared counter at 200 ITER times with FAA
+ *   2) ITER times takes the CAS spinlock at 201, increments the plain word
+ *      at 202 with LD/ADD/ST and releases the lock with ST
+ *   3) arrives at the FAA barrier at 203 and spins until all cores are in
+ * Core 0 then checks that both 200 and 202 reached ITER * N and writes
+ * 1 (PASS) or 2 (FAIL) to 204.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ADD         0
+#define SUB         1
+#define LSF         2
+#define RSF         3
+#define AND         4
+#define OR          5
+#define XOR         6
+#define LHI         7
+#define LD          8
+#define ST          9
+#define CPUID       14
+#define FAA         15
+#define JLT         16
+#define JLE         17
+#define JEQ         18
+#define JNE         19
+#define JIN         20
+#define CAS         21
+#define HLT         24
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define ITER        10      // ITER * N must be easy to compute: 8N + 2N
+#define COUNTER     200
+#define LOCK        201
+#define PROTECTED   202
+#define BARRIER     203
+#define RESULT      204
+
+unsigned int mem[MEM_SIZE];
+int pc = 0;
+
+static void asm_cmd(int opcode, int dst, int src0, int src1, int imm)
+{
+    int inst = ((opcode & 0x1F) << 25)
+             | ((dst     & 0x07) << 22)
+             | ((src0    & 0x07) << 19)
+             | ((src1    & 0x07) << 16)
+             | (imm       & 0xFFFF);
+    mem[pc++] = inst;
+}
+
+// point the branch at "at" to "target"
+static void patch(int at, int target)
+{
+    mem[at] = (mem[at] & ~0xFFFF) | (target & 0xFFFF);
+}
+
+static void assemble_program(const char *outname)
+{
+    int i, loop, lock, wait, done, fail0, fail1, halt;
+
+    for (i = 0; i < MEM_SIZE; i++) mem[i] = 0;
+
+    // r6 = N, r2 = i
+    asm_cmd(CPUID, 6, 0, 0, 1);
+
+    // 1) FAA counter
+    asm_cmd(ADD, 2, 0, 0, 0);
+    loop = pc;
+    asm_cmd(ADD, 5, 1, 0, COUNTER);
+    asm_cmd(FAA, 3, 1, 5, 1);            // r3 = MEM[r5], MEM[r5] += 1
+    asm_cmd(ADD, 2, 2, 1, 1);
+    asm_cmd(ADD, 3, 1, 0, ITER);
+    asm_cmd(JLT, 0, 2, 3, loop);
+
+    // 2) CAS spinlock around a plain read-modify-write
+    asm_cmd(ADD, 2, 0, 0, 0);
+    lock = pc;
+    asm_cmd(ADD, 5, 1, 0, LOCK);
+    asm_cmd(ADD, 3, 0, 0, 0);            // expected: free
+    asm_cmd(ADD, 4, 1, 0, 1);            // new: taken
+    asm_cmd(CAS, 3, 4, 5, 0);            // r3 = old lock value
+    asm_cmd(JNE, 0, 3, 0, lock);         // was taken, retry
+    asm_cmd(ADD, 5, 1, 0, PROTECTED);
+    asm_cmd(LD,  3, 0, 5, 0);
+    asm_cmd(ADD, 3, 3, 1, 1);
+    asm_cmd(ST,  0, 3, 5, 0);
+    asm_cmd(ADD, 5, 1, 0, LOCK);
+    asm_cmd(ST,  0, 0, 5, 0);            // release
+    asm_cmd(ADD, 2, 2, 1, 1);
+    asm_cmd(ADD, 3, 1, 0, ITER);
+    asm_cmd(JLT, 0, 2, 3, lock);
+
+    // 3) barrier
+    asm_cmd(ADD, 5, 1, 0, BARRIER);
+    asm_cmd(FAA, 3, 1, 5, 1);
+    wait = pc;
+    asm_cmd(LD,  3, 0, 5, 0);
+    asm_cmd(JLT, 0, 3, 6, wait);
+    asm_cmd(CPUID, 2, 0, 0, 0);
+    done = pc;
+    asm_cmd(JNE, 0, 2, 0, 0);            // only core 0 checks
+
+    // r4 = ITER * N
+    asm_cmd(LSF, 4, 6, 1, 3);
+    asm_cmd(LSF, 3, 6, 1, 1);
+    asm_cmd(ADD, 4, 4, 3, 0);
+    asm_cmd(ADD, 5, 1, 0, COUNTER);
+    asm_cmd(LD,  3, 0, 5, 0);
+    fail0 = pc;
+    asm_cmd(JNE, 0, 3, 4, 0);
+    asm_cmd(ADD, 5, 1, 0, PROTECTED);
+    asm_cmd(LD,  3, 0, 5, 0);
+    fail1 = pc;
+    asm_cmd(JNE, 0, 3, 4, 0);
+
+    // PASS
+    asm_cmd(ADD, 2, 1, 0, 1);
+    asm_cmd(ADD, 5, 1, 0, RESULT);
+    asm_cmd(ST,  0, 2, 5, 0);
+    halt = pc;
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    // FAIL
+    patch(fail0, pc);
+    patch(fail1, pc);
+    asm_cmd(ADD, 2, 1, 0, 2);
+    asm_cmd(ADD, 5, 1, 0, RESULT);
+    asm_cmd(ST,  0, 2, 5, 0);
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    patch(done, halt);
+
+    FILE *fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i <= RESULT; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: asm <output_sram.txt>\n");
+        return 1;
+    }
+    assemble_program(argv[1]);
+    printf("SP assembler generated %s (atomics test)\n", argv[1]);
+    return 0;
+}
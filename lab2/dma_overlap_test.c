@@ -18,6 +18,7 @@
 #define ST          9
 #define DMA_START   10
 #define DMA_STATUS  11
+#define WFE         13
 #define JLT         16
 #define JLE         17
 #define JEQ         18
@@ -58,30 +59,32 @@ static void assemble_program(const char *outname) {
     // 3) Start overlapping DMA 50→60
     asm_cmd(DMA_START, 0, 2, 3, 50);
 
-    // 4) Poll until DMA finishes
+    // 4) Sleep until the DMA completion event, then confirm with DMA_STATUS
+    int poll = pc;
+    asm_cmd(WFE,        0, 0, 0, 0);
     asm_cmd(DMA_STATUS, 5, 0, 0, 0);
-    asm_cmd(JNE,        0, 0, 5, 5);  // jump back to DMA_STATUS at PC=5
+    asm_cmd(JNE,        0, 0, 5, poll);  // still busy -> back to WFE
 
     // 5) Verify: for i=0..49 check mem[60+i] == mem[50+i]
-    // r6 = i index
+    // r6 = i index (only r2..r7 exist, so r5 is reused for the copy)
     asm_cmd(LHI, 6, 1, 0, 0);            // r6 = 0
 
-    // VERIFY_LOOP at PC=8
+    int verify_loop = pc;
     asm_cmd(ADD, 7, 6, 1, 50);           // r7 = 50 + i
     asm_cmd(LD,  7, 0, 7, 0);            // r7 = mem[50+i]
-    asm_cmd(ADD, 8, 6, 1, 60);           // r8 = 60 + i
-    asm_cmd(LD,  8, 0, 8, 0);            // r8 = mem[60+i]
-    asm_cmd(SUB, 9, 7, 8, 0);            // r9 = r7 - r8
-    asm_cmd(JNE,  0, 9, 0, 18);          // on mismatch jump to FAIL at PC=18
+    asm_cmd(ADD, 5, 6, 1, 60);           // r5 = 60 + i
+    asm_cmd(LD,  5, 0, 5, 0);            // r5 = mem[60+i]
+    asm_cmd(SUB, 5, 7, 5, 0);            // r5 = r7 - r5
+    asm_cmd(JNE,  0, 5, 0, pc + 5);      // on mismatch jump to FAIL
 
     asm_cmd(ADD, 6, 6, 1, 1);            // i++
-    asm_cmd(JLT,  0, 6, 4, 8);           // if i<50, loop back
+    asm_cmd(JLT,  0, 6, 4, verify_loop); // if i<50, loop back
 
-    // PASS: set r2=1 and halt (PC=17)
+    // PASS: set r2=1 and halt
     asm_cmd(ADD, 2, 1, 0, 1);
     asm_cmd(HLT,  0, 0, 0, 0);
 
-    // FAIL: set r2=0 and halt (PC=18)
+    // FAIL: set r2=0 and halt
     asm_cmd(ADD, 2, 1, 0, 0);
     asm_cmd(HLT,  0, 0, 0, 0);
 
@@ -0,0 +1,125 @@
+/*
+ * SP ASM: DMA Scatter-Gather Descriptor Chain Test
+ *
+ * Builds a chain of three descriptors in data memory and rings the DMA
+ * doorbell once (DMA_DOORBELL is implemented by the lab3_A pipelined core):
+ *   1) gather column 0 of an 8x4 matrix at 100 (stride 4) into 200..207
+ *   2) copy the contiguous block 100..107 to 220..227
+ *   3) scatter 200..207 to 240, 242, .., 254 (destination stride 2)
+ * The program then polls the completion flag (DMA_STATUS with imm 1),
+ * checks a word of every block, sets r2=1 on pass, r2=0 on fail, and halts.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ADD         0
+#define SUB         1
+#define LSF         2
+#define RSF         3
+#define AND         4
+#define OR          5
+#define XOR         6
+#define LHI         7
+#define LD          8
+#define ST          9
+#define DMA_START   10
+#define DMA_STATUS  11
+#define DMA_DOORBELL 12
+#define JLT         16
+#define JLE         17
+#define JEQ         18
+#define JNE         19
+#define JIN         20
+#define HLT         24
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+// descriptor layout: src, dst, len, stride (src | dst << 16), next
+#define DESC0       300
+#define DESC1       305
+#define DESC2       310
+
+unsigned int mem[MEM_SIZE];
+int pc = 0;
+
+static void asm_cmd(int opcode, int dst, int src0, int src1, int imm)
+{
+    int inst = ((opcode & 0x1F) << 25)
+             | ((dst     & 0x07) << 22)
+             | ((src0    & 0x07) << 19)
+             | ((src1    & 0x07) << 16)
+             | (imm       & 0xFFFF);
+    mem[pc++] = inst;
+}
+
+static void descriptor(int addr, int src, int dst, int len, int src_stride, int dst_stride, int next)
+{
+    mem[addr + 0] = src;
+    mem[addr + 1] = dst;
+    mem[addr + 2] = len;
+    mem[addr + 3] = (src_stride & 0xFFFF) | ((dst_stride & 0xFFFF) << 16);
+    mem[addr + 4] = next;
+}
+
+static void check(int addr, int expected, int fail_pc)
+{
+    asm_cmd(LD,  3, 0, 1, addr);         // r3 = mem[addr]
+    asm_cmd(SUB, 3, 3, 1, expected);     // r3 -= expected
+    asm_cmd(JNE, 0, 3, 0, fail_pc);      // mismatch -> FAIL
+}
+
+static void assemble_program(const char *outname)
+{
+    int i, fail;
+
+    for (i = 0; i < MEM_SIZE; i++) mem[i] = 0;
+    for (i = 0; i < 32; i++) mem[100 + i] = 0x100 + i;   // 8x4 matrix at 100..131
+
+    descriptor(DESC0, 100, 200, 8, 4, 1, DESC1);
+    descriptor(DESC1, 100, 220, 8, 1, 1, DESC2);
+    descriptor(DESC2, 200, 240, 8, 1, 2, 0);
+
+    // 0: r2 = first descriptor, ring the doorbell
+    asm_cmd(ADD, 2, 1, 0, DESC0);
+    asm_cmd(DMA_DOORBELL, 0, 2, 0, 0);
+
+    // 2: poll the completion flag
+    asm_cmd(DMA_STATUS, 4, 0, 0, 1);
+    asm_cmd(JEQ, 0, 4, 0, 2);
+
+    // 4: verify one word of each block, FAIL is after the 4 checks and PASS
+    fail = pc + 4 * 3 + 2;
+    check(203, 0x100 + 3 * 4, fail);     // gathered column
+    check(227, 0x107, fail);             // contiguous copy
+    check(240, 0x100, fail);             // first scattered word
+    check(254, 0x100 + 7 * 4, fail);     // last scattered word
+
+    // PASS: r2 = 1
+    asm_cmd(ADD, 2, 1, 0, 1);
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    // FAIL: r2 = 0
+    asm_cmd(ADD, 2, 1, 0, 0);
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    FILE *fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i <= DESC2 + 4; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: asm <output_sram.txt>\n");
+        return 1;
+    }
+    assemble_program(argv[1]);
+    printf("SP assembler generated %s (DMA scatter-gather test)\n", argv[1]);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * SP ASM: DMA Streaming Benchmark
+ *
+ * Sums 256 words that live in main memory (address 0x8000, above the
+ * scratchpad of a core built with SP_MAIN_MEM), either:
+ *   1) direct: LDI straight from main memory, every load waits for it
+ *   2) dma: DMA_START copies 32-word blocks into the scratchpad, the core
+ *      sums block k while the DMA fetches block k + 1
+ * Both variants store the sum at SUM, compare it with the value the
+ * assembler computed and write 1 (PASS) or 2 (FAIL) to RESULT. The cycle
+ * counts give the overlap the DMA buys.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADD         0
+#define SUB         1
+#define LD          8
+#define ST          9
+#define DMA_START   10
+#define DMA_STATUS  11
+#define WFE         13
+#define JEQ         18
+#define JNE         19
+#define HLT         24
+#define LOOP        27
+#define LDI         28
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define WORDS       256
+#define BLOCK       32
+#define RESULT      1002
+#define SUM         1003
+#define EXPECTED    1004
+#define SCRATCH     2048
+#define MAIN        0x8000
+
+unsigned int mem[MEM_SIZE];
+int pc = 0;
+
+static void asm_cmd(int opcode, int dst, int src0, int src1, int imm)
+{
+    int inst = ((opcode & 0x1F) << 25)
+             | ((dst     & 0x07) << 22)
+             | ((src0    & 0x07) << 19)
+             | ((src1    & 0x07) << 16)
+             | (imm       & 0xFFFF);
+    mem[pc++] = inst;
+}
+
+// r6 += the next count words at R[ptr], r5 is clobbered
+static void asm_sum(int ptr, int count)
+{
+    int at;
+
+    asm_cmd(ADD, 5, 1, 0, count);
+    at = pc;
+    asm_cmd(LOOP, 0, 5, 0, 0);
+    asm_cmd(LDI, 5, 0, ptr, 1);
+    asm_cmd(ADD, 6, 6, 5, 0);
+    mem[at] |= pc - 1;
+}
+
+static void assemble_program(const char *outname, int dma)
+{
+    int i, wait, skip, fail;
+    unsigned int sum = 0;
+
+    for (i = 0; i < MEM_SIZE; i++) mem[i] = 0;
+    for (i = 0; i < WORDS; i++) {
+        mem[MAIN + i] = i * 2654435761u + 7;
+        sum += mem[MAIN + i];
+    }
+    mem[EXPECTED] = sum;
+
+    asm_cmd(ADD, 2, 1, 0, MAIN);
+    asm_cmd(ADD, 6, 0, 0, 0);
+    if (!dma) {
+        // 1) r2 = main memory pointer
+        asm_sum(2, WORDS);
+    }
+    else {
+        // 2) r2 = next block in main memory, r3 = block to sum in the
+        //    scratchpad, the next one goes right after it, r4 = blocks left
+        asm_cmd(ADD, 3, 1, 0, SCRATCH);
+        asm_cmd(ADD, 4, 1, 0, WORDS / BLOCK);
+        asm_cmd(DMA_START, 0, 2, 3, BLOCK);
+        asm_cmd(ADD, 2, 2, 1, BLOCK);
+
+        // wait for block k, start block k + 1, sum block k
+        wait = pc;
+        asm_cmd(WFE,        0, 0, 0, 0);
+        asm_cmd(DMA_STATUS, 5, 0, 0, 0);
+        asm_cmd(JNE,        0, 5, 0, wait);
+        asm_cmd(SUB, 4, 4, 1, 1);
+        skip = pc;
+        asm_cmd(JEQ, 0, 4, 0, 0);
+        asm_cmd(ADD, 5, 3, 1, BLOCK);
+        asm_cmd(DMA_START, 0, 2, 5, BLOCK);
+        asm_cmd(ADD, 2, 2, 1, BLOCK);
+        mem[skip] |= pc;
+        asm_sum(3, BLOCK);
+        asm_cmd(JNE, 0, 4, 0, wait);
+    }
+    asm_cmd(ST,  0, 6, 1, SUM);
+
+    // check the sum
+    asm_cmd(LD,  4, 0, 1, EXPECTED);
+    fail = pc;
+    asm_cmd(JNE, 0, 6, 4, 0);
+    asm_cmd(ADD, 5, 1, 0, 1);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+    mem[fail] |= pc;
+    asm_cmd(ADD, 5, 1, 0, 2);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    FILE *fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i < MAIN + WORDS; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    int dma = 1;
+
+    if (argc == 3 && !strcmp(argv[2], "direct"))
+        dma = 0;
+    else if (argc != 2 && !(argc == 3 && !strcmp(argv[2], "dma"))) {
+        fprintf(stderr, "usage: asm <output_sram.txt> [dma|direct]\n");
+        return 1;
+    }
+    assemble_program(argv[1], dma);
+    printf("SP assembler generated %s (%s)\n", argv[1], dma ? "dma streaming" : "direct loads");
+    return 0;
+}
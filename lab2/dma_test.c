@@ -2,7 +2,9 @@
  * SP ASM: DMA Background Copy Test
  *
  * This program tests the DMA engine by copying 4 words from [100..103] to [200..203]
- * It then polls the DMA status and halts once the copy completes.
+ * It then sleeps in WFE until the DMA signals completion, confirms with
+ * DMA_STATUS and halts once the copy completes. On a core without WFE the
+ * instruction is a no-op and the loop degrades to plain polling.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,6 +21,7 @@
 #define ST          9
 #define DMA_START   10
 #define DMA_STATUS  11
+#define WFE         13
 #define JLT         16
 #define JLE         17
 #define JEQ         18
@@ -59,11 +62,13 @@ static void assemble_program(char* program_name)
     asm_cmd(ADD, 3, 1, 0, 200);
     // 2: kick off DMA copy of 4 words
     asm_cmd(DMA_START, 0, 2, 3, 4);
-    // 3: poll DMA status into r4
+    // 3: sleep until the DMA completion event
+    asm_cmd(WFE,       0, 0, 0, 0);
+    // 4: read DMA status into r4
     asm_cmd(DMA_STATUS, 4, 0, 0, 0);
-    // 4: if r4 != 0, jump back to instruction 3
+    // 5: if r4 != 0, go back to sleep at instruction 3
     asm_cmd(JNE,       0, 0, 4, 3);
-    // 5: halt when done
+    // 6: halt when done
     asm_cmd(HLT,       0, 0, 0, 0);
 
     // initialize source data at addresses 100..103
@@ -0,0 +1,55 @@
+; SP ASM: Integer Square Root
+;
+; Same interface as lab #1/sqrtq_asm.c: the input number is at 1000 and the
+; result goes to 1001.
+;
+;   make isqrt.bin      (or ./sp_asm isqrt.s isqrt.bin, which also writes isqrt.map)
+
+.equ INPUT, 1000
+.equ OUTPUT, 1001
+
+; R[reg] = value
+.macro LI reg, value
+        ADD  \reg, r1, r0, \value
+.endm
+
+.macro JMP target
+        JEQ  r0, r0, r0, \target
+.endm
+
+; r2 = N, r3 = bit, r4 = result, r5/r6 = temporaries
+start:  LD   r2, r0, r1, INPUT
+        LI   r4, 0
+        JEQ  r0, r2, r0, done
+
+; bit = largest power of four not above N
+        LI   r3, 1
+bitloop:
+        LSF  r5, r3, r1, 2
+        JEQ  r0, r5, r0, mainloop       ; bit is 1 << 30
+        JLT  r0, r2, r5, mainloop       ; N < bit * 4
+        ADD  r3, r5, r0, 0
+        JMP  bitloop
+
+; one result bit per iteration
+mainloop:
+        JEQ  r0, r3, r0, done
+        ADD  r6, r4, r3, 0
+        SUB  r6, r2, r6, 0
+        JLT  r0, r6, r0, smaller        ; N < result + bit
+        ADD  r2, r6, r0, 0              ; N -= result + bit
+        RSF  r4, r4, r1, 1
+        ADD  r4, r4, r3, 0              ; result = result / 2 + bit
+        JMP  next
+smaller:
+        RSF  r4, r4, r1, 1              ; result = result / 2
+next:
+        RSF  r3, r3, r1, 2
+        JMP  mainloop
+
+done:   ST   r0, r4, r1, OUTPUT
+        HLT
+
+.org INPUT
+        .word 3000                      ; N
+        .word 0                         ; result
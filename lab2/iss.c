@@ -17,17 +17,118 @@
 #define LHI 7
 #define LD  8
 #define ST  9
+#define CPUID 14   // R[dst] := core id (imm 0) or number of cores (imm 1)
+#define FAA 15     // R[dst] := MEM[R[src1]], MEM[R[src1]] += R[src0]
 #define JLT 16
 #define JLE 17
 #define JEQ 18
 #define JNE 19
 #define JIN 20
+#define CAS 21     // R[dst] := MEM[R[src1]], MEM[R[src1]] := R[src0] if it was R[dst]
+#define MUL 22     // R[dst] := R[src0] * R[src1], low 32 bits
+#define DIV 23     // R[dst] := R[src0] / R[src1], signed, -1 on division by zero
 #define HLT 24
+#define MOD 25     // R[dst] := R[src0] % R[src1], signed, R[src0] on division by zero
+#define SIMD 26    // R[dst] := packed operation imm[3:0] on R[src0], R[src1]
+#define LOOP 27    // run PC+1..imm R[src0] times (skipped if R[src0] <= 0)
+#define LDI 28     // R[dst] := MEM[R[src1]], R[src1] += imm
+#define STI 29     // MEM[R[src1]] := R[src0], R[src1] += imm
+
+// SIMD operations (imm[3:0]), 4x8 bit unsigned or 2x16 bit signed lanes
+#define SIMD_ADDB    0
+#define SIMD_SUBB    1
+#define SIMD_ADDUSB  2
+#define SIMD_MINUB   3
+#define SIMD_MAXUB   4
+#define SIMD_ADDH    5
+#define SIMD_SUBH    6
+#define SIMD_ADDSH   7
+#define SIMD_MINH    8
+#define SIMD_MAXH    9
+#define SIMD_SHUFB  10  // byte i := R[src0] byte imm[9+2i:8+2i]
+#define SIMD_SUMB   11  // R[src1] + the four bytes of R[src0]
+
+// atomics by address: operations and CAS failures (software retries)
+#define AMO_STATS 16
+
+struct amo_stat {
+    uint32_t addr;
+    long long ops;
+    long long cas_fails;
+};
+
+struct amo_stat amo_stats[AMO_STATS];
+int nr_amo_stats;
+
+struct amo_stat *amo_stat(uint32_t addr) {
+    for (int i = 0; i < nr_amo_stats; i++)
+        if (amo_stats[i].addr == addr)
+            return &amo_stats[i];
+    if (nr_amo_stats == AMO_STATS)
+        return &amo_stats[AMO_STATS - 1];
+    amo_stats[nr_amo_stats].addr = addr;
+    return &amo_stats[nr_amo_stats++];
+}
+
+int32_t muldiv(int opcode, int32_t a, int32_t b) {
+    if (opcode == MUL)
+        return (int32_t)((uint32_t)a * (uint32_t)b);
+    if (b == 0)
+        return (opcode == DIV) ? -1 : a;
+    if (a == INT32_MIN && b == -1)
+        return (opcode == DIV) ? a : 0;
+    return (opcode == DIV) ? a / b : a % b;
+}
+
+int32_t simd(int imm, int32_t a, int32_t b) {
+    uint32_t res = 0;
+    int op = imm & 0xF;
+
+    if (op <= SIMD_MAXUB) {
+        for (int i = 0; i < 32; i += 8) {
+            int x = ((uint32_t)a >> i) & 0xFF, y = ((uint32_t)b >> i) & 0xFF, r;
+            switch (op) {
+                case SIMD_ADDB:   r = x + y; break;
+                case SIMD_SUBB:   r = x - y; break;
+                case SIMD_ADDUSB: r = (x + y > 0xFF) ? 0xFF : x + y; break;
+                case SIMD_MINUB:  r = (x < y) ? x : y; break;
+                default:          r = (x > y) ? x : y; break;
+            }
+            res |= (uint32_t)(r & 0xFF) << i;
+        }
+    } else if (op <= SIMD_MAXH) {
+        for (int i = 0; i < 32; i += 16) {
+            int x = (int16_t)((uint32_t)a >> i), y = (int16_t)((uint32_t)b >> i), r;
+            switch (op) {
+                case SIMD_ADDH:  r = x + y; break;
+                case SIMD_SUBH:  r = x - y; break;
+                case SIMD_ADDSH: r = (x + y > INT16_MAX) ? INT16_MAX : (x + y < INT16_MIN) ? INT16_MIN : x + y; break;
+                case SIMD_MINH:  r = (x < y) ? x : y; break;
+                default:         r = (x > y) ? x : y; break;
+            }
+            res |= (uint32_t)(r & 0xFFFF) << i;
+        }
+    } else if (op == SIMD_SHUFB) {
+        for (int i = 0; i < 4; i++)
+            res |= (((uint32_t)a >> (8 * ((imm >> (8 + 2 * i)) & 3))) & 0xFF) << (8 * i);
+    } else if (op == SIMD_SUMB) {
+        res = b + (a & 0xFF) + ((a >> 8) & 0xFF) + ((a >> 16) & 0xFF) + (((uint32_t)a >> 24) & 0xFF);
+    }
+    return (int32_t)res;
+}
 
 uint32_t mem[MEM_SIZE];
 int32_t reg[REG_COUNT] = {0};
 uint32_t pc = 0;
 
+// hardware loop: back from lp_end to lp_start lp_count more times
+uint32_t lp_start, lp_end;
+int32_t lp_count;
+
+// profile.txt, per address: executions, taken branches, data accesses
+long long exec_count[MEM_SIZE], taken_count[MEM_SIZE];
+uint8_t accessed[MEM_SIZE];
+
 FILE *trace_fp, *sram_fp;
 
 void trace_instruction(uint32_t inst, uint32_t current_pc) {
@@ -51,12 +152,22 @@ void trace_instruction(uint32_t inst, uint32_t current_pc) {
         case 7:  op_str = "LHI"; break;
         case 8:  op_str = "LD";  break;
         case 9:  op_str = "ST";  break;
+        case 14: op_str = "CPUID"; break;
+        case 15: op_str = "FAA"; break;
         case 16: op_str = "JLT"; break;
         case 17: op_str = "JLE"; break;
         case 18: op_str = "JEQ"; break;
         case 19: op_str = "JNE"; break;
         case 20: op_str = "JIN"; break;
+        case 21: op_str = "CAS"; break;
+        case 22: op_str = "MUL"; break;
+        case 23: op_str = "DIV"; break;
         case 24: op_str = "HLT"; break;
+        case 25: op_str = "MOD"; break;
+        case 26: op_str = "SIMD"; break;
+        case 27: op_str = "LOOP"; break;
+        case 28: op_str = "LDI"; break;
+        case 29: op_str = "STI"; break;
         default: op_str = "UNK"; break;
     }
     
@@ -79,6 +190,18 @@ void dump_sram() {
     }
 }
 
+// "addr executed taken accessed" for every address that shows up, the input
+// of sp_layout
+void dump_profile() {
+    FILE *fp = fopen("profile.txt", "w");
+    if (!fp)
+        return;
+    for (int i = 0; i < MEM_SIZE; i++)
+        if (exec_count[i] || accessed[i])
+            fprintf(fp, "%d %lld %lld %d\n", i, exec_count[i], taken_count[i], accessed[i]);
+    fclose(fp);
+}
+
 int main(int argc, char *argv[]) {
     if (argc != 2) {
         fprintf(stderr, "Usage: %s code.bin\n", argv[0]);
@@ -115,6 +238,15 @@ int main(int argc, char *argv[]) {
         int32_t val0 = src0 == 0 ? 0 : (src0 == 1 ? imm : reg[src0]);
         int32_t val1 = src1 == 0 ? 0 : (src1 == 1 ? imm : reg[src1]);
 
+        // the last instruction of the loop body counts an iteration
+        int loop_back = (current_pc == lp_end && lp_count > 0);
+        int taken = 0;
+        if (loop_back)
+            lp_count--;
+        exec_count[current_pc]++;
+        if (opcode == LD || opcode == ST || opcode == LDI || opcode == STI || opcode == FAA || opcode == CAS)
+            accessed[val1 & 0xFFFF] = 1;
+
         switch (opcode) {
             case ADD: reg[dst] = val0 + val1; break;
             case SUB: reg[dst] = val0 - val1; break;
@@ -123,37 +255,87 @@ int main(int argc, char *argv[]) {
             case AND: reg[dst] = val0 & val1; break;
             case OR:  reg[dst] = val0 | val1; break;
             case XOR: reg[dst] = val0 ^ val1; break;
+            case MUL: case DIV: case MOD: reg[dst] = muldiv(opcode, val0, val1); break;
+            case SIMD: reg[dst] = simd(imm, val0, val1); break;
             case LHI: reg[dst] = (val1 << 16) | (val0 & 0xFFFF); break;
             case LD:  reg[dst] = mem[val1 & 0xFFFF]; break;
             case ST:  mem[val1 & 0xFFFF] = reg[src0]; break;
 
+            // post-increment, a loaded R[dst] wins over the address update
+            case LDI: {
+                uint32_t data = mem[val1 & 0xFFFF];
+                if (src1 >= 2)
+                    reg[src1] = val1 + imm;
+                reg[dst] = data;
+                break;
+            }
+            case STI:
+                mem[val1 & 0xFFFF] = reg[src0];
+                if (src1 >= 2)
+                    reg[src1] = val1 + imm;
+                break;
+
+            // single core: id 0 of 1
+            case CPUID: reg[dst] = (imm == 1) ? 1 : 0; break;
+
+            case FAA: {
+                uint32_t old = mem[val1 & 0xFFFF];
+                mem[val1 & 0xFFFF] = old + val0;
+                reg[dst] = old;
+                amo_stat(val1 & 0xFFFF)->ops++;
+                break;
+            }
+            case CAS: {
+                uint32_t old = mem[val1 & 0xFFFF];
+                if (old == (uint32_t)reg[dst])
+                    mem[val1 & 0xFFFF] = val0;
+                else
+                    amo_stat(val1 & 0xFFFF)->cas_fails++;
+                reg[dst] = old;
+                amo_stat(val1 & 0xFFFF)->ops++;
+                break;
+            }
+
             case JLT:
                 if (val0 < val1) {
                     reg[7] = pc;  // Save pc into r7
                     pc = imm & 0xFFFF;
+                    taken = 1;
                 }
                 break;
             case JLE:
                 if (val0 <= val1) {
                     reg[7] = pc;  // Save pc into r7
                     pc = imm & 0xFFFF;
+                    taken = 1;
                 }
                 break;
             case JEQ:
                 if (val0 == val1) {
                     reg[7] = pc;  // Save pc into r7
                     pc = imm & 0xFFFF;
+                    taken = 1;
                 }
                 break;
             case JNE:
                 if (val0 != val1) {
                     reg[7] = pc;  // Save pc into r7
                     pc = imm & 0xFFFF;
+                    taken = 1;
                 }
                 break;
             case JIN:
                 reg[7] = pc;  // Save pc from reg[src0] into r7
                 pc = reg[src0] & 0xFFFF;
+                taken = 1;
+                break;
+            case LOOP:
+                lp_start = pc;
+                lp_end = imm & 0xFFFF;
+                lp_count = (val0 > 0) ? val0 - 1 : 0;
+                if (val0 <= 0)
+                    pc = lp_end + 1;
+                taken = 1;
                 break;
 
             case HLT:
@@ -164,11 +346,24 @@ int main(int argc, char *argv[]) {
                 break; // undefined op: do nothing
         }
 
+        if (taken && opcode != LOOP)
+            taken_count[current_pc]++;
+
+        // a branch out of the loop body ends the loop
+        if (taken && (pc < lp_start || pc > lp_end))
+            lp_count = 0;
+        else if (loop_back && !taken)
+            pc = lp_start;
+
         // Use the saved PC for correct trace output
         trace_instruction(inst, current_pc);
     }
 
     dump_sram();
+    dump_profile();
+    for (int i = 0; i < nr_amo_stats; i++)
+        printf("amo addr %u ops %lld cas_fails %lld\n",
+               amo_stats[i].addr, amo_stats[i].ops, amo_stats[i].cas_fails);
     fclose(trace_fp);
     fclose(sram_fp);
     return 0;
@@ -0,0 +1,196 @@
+/*
+ * SP ASM: Hardware Loop Benchmark
+ *
+ * The loops of the existing test programs, built either with a counter and
+ * a backward branch or with the LOOP instruction:
+ *   1) sum: 50 word sum of A, stored at SUM
+ *   2) compare: the check loop of the DMA test, A against B word by word,
+ *      leaving on the first mismatch, RESULT gets 1 (PASS) or 2 (FAIL)
+ *   3) sqrt: the bit loops of lab #1/sqrtq_asm.c, input at 1000 and result
+ *      at 1001, both loops leave early through a branch out of the body
+ * Both variants leave the same results, the difference of the cycle
+ * counts divided by the iterations is the cost of the backward branch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADD         0
+#define SUB         1
+#define LSF         2
+#define RSF         3
+#define AND         4
+#define OR          5
+#define XOR         6
+#define LHI         7
+#define LD          8
+#define ST          9
+#define JLT         16
+#define JLE         17
+#define JEQ         18
+#define JNE         19
+#define JIN         20
+#define HLT         24
+#define LOOP        27
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define WORDS       50
+#define INPUT       1000
+#define OUTPUT      1001
+#define RESULT      1002
+#define SUM         1003
+#define A           1024
+#define B           1088
+
+unsigned int mem[MEM_SIZE];
+int pc = 0;
+
+static void asm_cmd(int opcode, int dst, int src0, int src1, int imm)
+{
+    int inst = ((opcode & 0x1F) << 25)
+             | ((dst     & 0x07) << 22)
+             | ((src0    & 0x07) << 19)
+             | ((src1    & 0x07) << 16)
+             | (imm       & 0xFFFF);
+    mem[pc++] = inst;
+}
+
+// point the branch or LOOP at "at" to "target"
+static void patch(int at, int target)
+{
+    mem[at] = (mem[at] & ~0xFFFF) | (target & 0xFFFF);
+}
+
+// loop head: LOOP on R[count], or nothing (the count is kept by the body)
+static int loop_begin(int hw, int count)
+{
+    int at = pc;
+
+    if (hw)
+        asm_cmd(LOOP, 0, count, 0, 0);
+    return at;
+}
+
+// loop tail: close the LOOP body, or count down R[count] and branch back
+static void loop_end(int hw, int at, int count)
+{
+    if (hw) {
+        patch(at, pc - 1);
+    }
+    else {
+        asm_cmd(SUB, count, count, 1, 1);
+        asm_cmd(JNE, 0, count, 0, at);
+    }
+}
+
+static void assemble_program(const char *outname, int hw, int n)
+{
+    int i, at, fail, zero, bitout, done, other, next;
+
+    for (i = 0; i < MEM_SIZE; i++) mem[i] = 0;
+    for (i = 0; i < WORDS; i++)
+        mem[A + i] = mem[B + i] = i * 7919 + 13;
+    mem[INPUT] = n;
+
+    // 1) sum, r2 = index, r3 = sum, r6 = count
+    asm_cmd(ADD, 2, 0, 0, 0);
+    asm_cmd(ADD, 3, 0, 0, 0);
+    asm_cmd(ADD, 6, 1, 0, WORDS);
+    at = loop_begin(hw, 6);
+    asm_cmd(ADD, 5, 2, 1, A);
+    asm_cmd(LD,  4, 0, 5, 0);
+    asm_cmd(ADD, 3, 3, 4, 0);
+    asm_cmd(ADD, 2, 2, 1, 1);
+    loop_end(hw, at, 6);
+    asm_cmd(ST,  0, 3, 1, SUM);
+
+    // 2) compare, r2 = index, r6 = count
+    asm_cmd(ADD, 2, 0, 0, 0);
+    asm_cmd(ADD, 6, 1, 0, WORDS);
+    at = loop_begin(hw, 6);
+    asm_cmd(ADD, 5, 2, 1, A);
+    asm_cmd(LD,  3, 0, 5, 0);
+    asm_cmd(ADD, 5, 2, 1, B);
+    asm_cmd(LD,  4, 0, 5, 0);
+    fail = pc;
+    asm_cmd(JNE, 0, 3, 4, 0);
+    asm_cmd(ADD, 2, 2, 1, 1);
+    loop_end(hw, at, 6);
+    asm_cmd(ADD, 5, 1, 0, 1);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+
+    // 3) sqrt, r2 = N, r3 = bit, r4 = result, r6 = count of the bit loop,
+    // r5 = count of the main loop
+    asm_cmd(LD,  2, 0, 1, INPUT);
+    asm_cmd(ADD, 4, 0, 0, 0);
+    zero = pc;
+    asm_cmd(JEQ, 0, 2, 0, 0);
+
+    // largest power of four not above N
+    asm_cmd(ADD, 3, 1, 0, 1);
+    asm_cmd(ADD, 6, 1, 0, 15);
+    at = loop_begin(hw, 6);
+    asm_cmd(LSF, 5, 3, 1, 2);
+    bitout = pc;
+    asm_cmd(JLT, 0, 2, 5, 0);
+    asm_cmd(ADD, 3, 5, 0, 0);
+    loop_end(hw, at, 6);
+    patch(bitout, pc);
+
+    // one result bit per iteration, done once bit is 0
+    asm_cmd(ADD, 5, 1, 0, 16);
+    at = loop_begin(hw, 5);
+    done = pc;
+    asm_cmd(JEQ, 0, 3, 0, 0);
+    asm_cmd(ADD, 6, 4, 3, 0);
+    asm_cmd(SUB, 6, 2, 6, 0);
+    other = pc;
+    asm_cmd(JLT, 0, 6, 0, 0);
+    asm_cmd(SUB, 2, 2, 4, 0);
+    asm_cmd(SUB, 2, 2, 3, 0);
+    asm_cmd(RSF, 4, 4, 1, 1);
+    asm_cmd(ADD, 4, 4, 3, 0);
+    next = pc;
+    asm_cmd(JEQ, 0, 0, 0, 0);
+    patch(other, pc);
+    asm_cmd(RSF, 4, 4, 1, 1);
+    patch(next, pc);
+    asm_cmd(RSF, 3, 3, 1, 2);
+    loop_end(hw, at, 5);
+    patch(done, pc);
+    patch(zero, pc);
+    asm_cmd(ST,  0, 4, 1, OUTPUT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    // FAIL
+    patch(fail, pc);
+    asm_cmd(ADD, 5, 1, 0, 2);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    FILE *fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i < B + WORDS; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    int hw = 1;
+
+    if (argc >= 3 && !strcmp(argv[2], "branch"))
+        hw = 0;
+    else if (argc < 2 || argc > 4 || (argc >= 3 && strcmp(argv[2], "loop"))) {
+        fprintf(stderr, "usage: asm <output_sram.txt> [loop|branch] [N]\n");
+        return 1;
+    }
+    assemble_program(argv[1], hw, argc == 4 ? atoi(argv[3]) : 3000);
+    printf("SP assembler generated %s (%s loops)\n", argv[1], hw ? "LOOP" : "branch");
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * SP ASM: Multi-Core Parallel Sum Test
+ *
+ * Every core of the lab3_A multi-core configuration (SP_NR_CORES) runs the
+ * same program. Core i sums the elements i, i+N, i+2N, .. of a 64 word array
+ * at 100 (CPUID gives i and N), stores its partial sum at 200+i and raises
+ * the flag at 210+i. Core 0 then waits for every flag, adds the partial sums
+ * and stores the total (0x820) at 220. Up to 8 cores.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ADD         0
+#define SUB         1
+#define LSF         2
+#define RSF         3
+#define AND         4
+#define OR          5
+#define XOR         6
+#define LHI         7
+#define LD          8
+#define ST          9
+#define CPUID       14
+#define JLT         16
+#define JLE         17
+#define JEQ         18
+#define JNE         19
+#define JIN         20
+#define HLT         24
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define ARRAY       100
+#define ARRAY_LEN   64
+#define PARTIAL     200
+#define FLAG        210
+#define TOTAL       220
+
+unsigned int mem[MEM_SIZE];
+int pc = 0;
+
+static void asm_cmd(int opcode, int dst, int src0, int src1, int imm)
+{
+    int inst = ((opcode & 0x1F) << 25)
+             | ((dst     & 0x07) << 22)
+             | ((src0    & 0x07) << 19)
+             | ((src1    & 0x07) << 16)
+             | (imm       & 0xFFFF);
+    mem[pc++] = inst;
+}
+
+static void assemble_program(const char *outname)
+{
+    int i, loop, wait, halt;
+
+    for (i = 0; i < MEM_SIZE; i++) mem[i] = 0;
+    for (i = 0; i < ARRAY_LEN; i++) mem[ARRAY + i] = i + 1;
+
+    // 0: r2 = i = core id, r4 = N, r3 = sum, r6 = array length
+    asm_cmd(CPUID, 2, 0, 0, 0);
+    asm_cmd(CPUID, 4, 0, 0, 1);
+    asm_cmd(ADD, 3, 0, 0, 0);
+    asm_cmd(ADD, 6, 1, 0, ARRAY_LEN);
+
+    // 4: sum += mem[ARRAY + i], i += N
+    loop = pc;
+    asm_cmd(ADD, 5, 2, 1, ARRAY);
+    asm_cmd(LD,  5, 0, 5, 0);
+    asm_cmd(ADD, 3, 3, 5, 0);
+    asm_cmd(ADD, 2, 2, 4, 0);
+    asm_cmd(JLT, 0, 2, 6, loop);
+
+    // 9: publish the partial sum, then the flag
+    asm_cmd(CPUID, 2, 0, 0, 0);
+    asm_cmd(ADD, 5, 2, 1, PARTIAL);
+    asm_cmd(ST,  0, 3, 5, 0);
+    asm_cmd(ADD, 5, 2, 1, FLAG);
+    asm_cmd(ADD, 3, 1, 0, 1);
+    asm_cmd(ST,  0, 3, 5, 0);
+    halt = pc + 1 + 12;                  // past the 12 instruction gather block
+    asm_cmd(JNE, 0, 2, 0, halt);         // cores other than 0 are done
+
+    // 16: core 0 gathers, r2 = j, r3 = total
+    asm_cmd(ADD, 2, 0, 0, 0);
+    asm_cmd(ADD, 3, 0, 0, 0);
+    wait = pc;
+    asm_cmd(ADD, 5, 2, 1, FLAG);
+    asm_cmd(LD,  5, 0, 5, 0);
+    asm_cmd(JEQ, 0, 5, 0, wait);         // spin on core j's flag
+    asm_cmd(ADD, 5, 2, 1, PARTIAL);
+    asm_cmd(LD,  5, 0, 5, 0);
+    asm_cmd(ADD, 3, 3, 5, 0);
+    asm_cmd(ADD, 2, 2, 1, 1);
+    asm_cmd(JLT, 0, 2, 4, wait);
+
+    // 26: mem[TOTAL] = total
+    asm_cmd(ADD, 5, 1, 0, TOTAL);
+    asm_cmd(ST,  0, 3, 5, 0);
+
+    // 28: halt
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    FILE *fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i <= TOTAL; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: asm <output_sram.txt>\n");
+        return 1;
+    }
+    assemble_program(argv[1]);
+    printf("SP assembler generated %s (multi-core parallel sum test)\n", argv[1]);
+    return 0;
+}
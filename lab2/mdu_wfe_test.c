@@ -0,0 +1,107 @@
+/*
+ * SP ASM: Multiply/Divide Unit and WFE Test
+ *
+ * Starts a 64 word DMA copy, issues a DIV and goes to sleep in WFE while the
+ * lab3_A multiply/divide unit still works on it. After the wake up it stores
+ * the quotient at QUOT, checks it and the last copied word and writes 1
+ * (PASS) or 2 (FAIL) to RESULT.
+ *
+ * The core sleeps with a result in flight, so llsim must not skip quiescent
+ * clocks before it is written back: the cycle count and traces have to be
+ * the same with LLSIM_SKIP_IDLE 0 and 1.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ADD         0
+#define LD          8
+#define ST          9
+#define DMA_START   10
+#define WFE         13
+#define JNE         19
+#define DIV         23
+#define HLT         24
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define LEN         64
+#define SRC         256
+#define DST         512
+#define RESULT      1000
+#define QUOT        1001
+#define OPERANDS    1002
+#define DIVIDEND    1000003
+#define DIVISOR     7
+
+unsigned int mem[MEM_SIZE];
+int pc = 0;
+
+static void asm_cmd(int opcode, int dst, int src0, int src1, int imm)
+{
+    int inst = ((opcode & 0x1F) << 25)
+             | ((dst     & 0x07) << 22)
+             | ((src0    & 0x07) << 19)
+             | ((src1    & 0x07) << 16)
+             | (imm       & 0xFFFF);
+    mem[pc++] = inst;
+}
+
+static void assemble_program(const char *outname)
+{
+    int i, fail1, fail2;
+
+    for (i = 0; i < MEM_SIZE; i++) mem[i] = 0;
+    for (i = 0; i < LEN; i++) mem[SRC + i] = i + 1;
+    mem[OPERANDS] = DIVIDEND;
+    mem[OPERANDS + 1] = DIVIDEND / DIVISOR;
+
+    // r2 = SRC, r3 = DST, r4 = dividend, r5 = divisor
+    asm_cmd(ADD, 2, 1, 0, SRC);
+    asm_cmd(ADD, 3, 1, 0, DST);
+    asm_cmd(LD,  4, 0, 1, OPERANDS);
+    asm_cmd(ADD, 5, 1, 0, DIVISOR);
+    asm_cmd(DMA_START, 0, 2, 3, LEN);
+
+    // r6 = r4 / r5 finishes while the core sleeps
+    asm_cmd(DIV, 6, 4, 5, 0);
+    asm_cmd(WFE, 0, 0, 0, 0);
+    asm_cmd(ST,  0, 6, 1, QUOT);
+
+    // check the quotient and the copy
+    asm_cmd(LD,  5, 0, 1, OPERANDS + 1);
+    fail1 = pc;
+    asm_cmd(JNE, 0, 6, 5, 0);
+    asm_cmd(LD,  4, 0, 1, DST + LEN - 1);
+    asm_cmd(ADD, 5, 1, 0, LEN);
+    fail2 = pc;
+    asm_cmd(JNE, 0, 4, 5, 0);
+    asm_cmd(ADD, 5, 1, 0, 1);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+    mem[fail1] |= pc;
+    mem[fail2] |= pc;
+    asm_cmd(ADD, 5, 1, 0, 2);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    FILE *fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i <= OPERANDS + 1; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: asm <output_sram.txt>\n");
+        return 1;
+    }
+    assemble_program(argv[1]);
+    printf("SP assembler generated %s (multiply/divide unit and WFE test)\n", argv[1]);
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * SP ASM: Post-Increment LD/ST Benchmark
+ *
+ * Two streaming kernels over 64 words, unrolled twice and run with LOOP,
+ * built either with LD/ST and an ADD per pointer bump or with LDI/STI:
+ *   1) memcpy: A to B
+ *   2) sum: sum of the words of B, stored at SUM, the core compares it with
+ *      the value the assembler computed and writes 1 (PASS) or 2 (FAIL) to
+ *      RESULT
+ * Both variants leave the same results, the instruction and cycle counts
+ * give the cost of the pointer updates.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADD         0
+#define SUB         1
+#define LD          8
+#define ST          9
+#define JNE         19
+#define HLT         24
+#define LOOP        27
+#define LDI         28
+#define STI         29
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define WORDS       64
+#define RESULT      1002
+#define SUM         1003
+#define EXPECTED    1004
+#define A           1024
+#define B           1088
+
+unsigned int mem[MEM_SIZE];
+int pc = 0;
+
+static void asm_cmd(int opcode, int dst, int src0, int src1, int imm)
+{
+    int inst = ((opcode & 0x1F) << 25)
+             | ((dst     & 0x07) << 22)
+             | ((src0    & 0x07) << 19)
+             | ((src1    & 0x07) << 16)
+             | (imm       & 0xFFFF);
+    mem[pc++] = inst;
+}
+
+// R[dst] = MEM[R[ptr]], R[ptr] += 1
+static void asm_load(int postinc, int dst, int ptr)
+{
+    if (postinc) {
+        asm_cmd(LDI, dst, 0, ptr, 1);
+    }
+    else {
+        asm_cmd(LD,  dst, 0, ptr, 0);
+        asm_cmd(ADD, ptr, ptr, 1, 1);
+    }
+}
+
+// MEM[R[ptr]] = R[src], R[ptr] += 1
+static void asm_store(int postinc, int src, int ptr)
+{
+    if (postinc) {
+        asm_cmd(STI, 0, src, ptr, 1);
+    }
+    else {
+        asm_cmd(ST,  0, src, ptr, 0);
+        asm_cmd(ADD, ptr, ptr, 1, 1);
+    }
+}
+
+static void assemble_program(const char *outname, int postinc)
+{
+    int i, at, fail;
+    unsigned int sum = 0;
+
+    for (i = 0; i < MEM_SIZE; i++) mem[i] = 0;
+    for (i = 0; i < WORDS; i++) {
+        mem[A + i] = i * 40503 + 17;
+        sum += mem[A + i];
+    }
+    mem[EXPECTED] = sum;
+
+    // 1) memcpy, r2 = source, r3 = destination, r6 = count
+    asm_cmd(ADD, 2, 1, 0, A);
+    asm_cmd(ADD, 3, 1, 0, B);
+    asm_cmd(ADD, 6, 1, 0, WORDS / 2);
+    at = pc;
+    asm_cmd(LOOP, 0, 6, 0, 0);
+    asm_load(postinc, 4, 2);
+    asm_load(postinc, 5, 2);
+    asm_store(postinc, 4, 3);
+    asm_store(postinc, 5, 3);
+    mem[at] |= pc - 1;
+
+    // 2) sum, r2 = pointer, r3 = sum, r6 = count
+    asm_cmd(ADD, 2, 1, 0, B);
+    asm_cmd(ADD, 3, 0, 0, 0);
+    asm_cmd(ADD, 6, 1, 0, WORDS / 2);
+    at = pc;
+    asm_cmd(LOOP, 0, 6, 0, 0);
+    asm_load(postinc, 4, 2);
+    asm_load(postinc, 5, 2);
+    asm_cmd(ADD, 3, 3, 4, 0);
+    asm_cmd(ADD, 3, 3, 5, 0);
+    mem[at] |= pc - 1;
+    asm_cmd(ST,  0, 3, 1, SUM);
+
+    // check the sum
+    asm_cmd(LD,  4, 0, 1, EXPECTED);
+    fail = pc;
+    asm_cmd(JNE, 0, 3, 4, 0);
+    asm_cmd(ADD, 5, 1, 0, 1);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+    mem[fail] |= pc;
+    asm_cmd(ADD, 5, 1, 0, 2);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    FILE *fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i < B + WORDS; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    int postinc = 1;
+
+    if (argc == 3 && !strcmp(argv[2], "plain"))
+        postinc = 0;
+    else if (argc != 2 && !(argc == 3 && !strcmp(argv[2], "postinc"))) {
+        fprintf(stderr, "usage: asm <output_sram.txt> [postinc|plain]\n");
+        return 1;
+    }
+    assemble_program(argv[1], postinc);
+    printf("SP assembler generated %s (%s kernels)\n", argv[1], postinc ? "post-increment" : "plain");
+    return 0;
+}
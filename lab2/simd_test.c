@@ -0,0 +1,201 @@
+/*
+ * SP ASM: Packed SIMD Benchmark
+ *
+ * Two byte-oriented kernels over 64 word (256 byte) buffers, built either
+ * with scalar instructions or with the SIMD opcode:
+ *   1) checksum: sum of the bytes of A, stored at CHECKSUM, core compares it
+ *      with the value the assembler computed and writes 1 (PASS) or 2 (FAIL)
+ *      to RESULT
+ *   2) blend: OUT = A + B per byte with unsigned saturation
+ * Both variants leave the same memory image, so their sram dumps can be
+ * compared, and the cycle counts give the bytes per cycle of each. The
+ * prologue runs every SIMD operation once on two constants (results at OPS)
+ * to cross-check the ISS and the cores.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADD         0
+#define SUB         1
+#define LSF         2
+#define RSF         3
+#define AND         4
+#define OR          5
+#define XOR         6
+#define LHI         7
+#define LD          8
+#define ST          9
+#define JLT         16
+#define JLE         17
+#define JEQ         18
+#define JNE         19
+#define JIN         20
+#define HLT         24
+#define SIMD        26
+
+#define SIMD_ADDUSB  2
+#define SIMD_SHUFB  10
+#define SIMD_SUMB   11
+#define SIMD_OPS    12
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define WORDS       64
+#define A           1024
+#define B           1088
+#define OUT         1152
+#define CHECKSUM    1216
+#define EXPECTED    1217
+#define RESULT      1218
+#define OPS         1232
+
+unsigned int mem[MEM_SIZE];
+int pc = 0;
+
+static void asm_cmd(int opcode, int dst, int src0, int src1, int imm)
+{
+    int inst = ((opcode & 0x1F) << 25)
+             | ((dst     & 0x07) << 22)
+             | ((src0    & 0x07) << 19)
+             | ((src1    & 0x07) << 16)
+             | (imm       & 0xFFFF);
+    mem[pc++] = inst;
+}
+
+// R[dst] = hi << 16 | lo, lo below 0x8000
+static void asm_const(int dst, int hi, int lo)
+{
+    asm_cmd(ADD, dst, 1, 0, hi);
+    asm_cmd(LSF, dst, dst, 1, 16);
+    asm_cmd(OR,  dst, dst, 1, lo);
+}
+
+static void assemble_program(const char *outname, int simd)
+{
+    int i, k, loop, fail;
+    unsigned int sum = 0;
+
+    for (i = 0; i < MEM_SIZE; i++) mem[i] = 0;
+    for (i = 0; i < WORDS; i++) {
+        for (k = 0; k < 4; k++) {
+            mem[A + i] |= ((i * 37 + k * 61 + 11) & 0xFF) << (8 * k);
+            mem[B + i] |= ((i * 91 + k * 29 + 200) & 0xFF) << (8 * k);
+            sum += (i * 37 + k * 61 + 11) & 0xFF;
+        }
+    }
+    mem[EXPECTED] = sum;
+
+    // every SIMD operation on 0x80ff7f01 and 0x10ff407f, byte reverse for SHUFB
+    asm_const(2, 0x80FF, 0x7F01);
+    asm_const(3, 0x10FF, 0x407F);
+    for (i = 0; i < SIMD_OPS; i++) {
+        asm_cmd(SIMD, 5, 2, 3, i | (i == SIMD_SHUFB ? 0x1B00 : 0));
+        asm_cmd(ST,   0, 5, 1, OPS + i);
+    }
+
+    // 1) checksum, r2 = words left, r3 = sum
+    asm_cmd(ADD, 2, 1, 0, WORDS);
+    asm_cmd(ADD, 3, 0, 0, 0);
+    loop = pc;
+    asm_cmd(ADD, 5, 2, 1, A - 1);
+    asm_cmd(LD,  4, 0, 5, 0);
+    if (simd) {
+        asm_cmd(SIMD, 3, 4, 3, SIMD_SUMB);
+    }
+    else {
+        for (k = 0; k < 4; k++) {
+            if (k) {
+                asm_cmd(RSF, 5, 4, 1, 8 * k);
+                asm_cmd(AND, 5, 5, 1, 0xFF);
+            }
+            else {
+                asm_cmd(AND, 5, 4, 1, 0xFF);
+            }
+            asm_cmd(ADD, 3, 3, 5, 0);
+        }
+    }
+    asm_cmd(SUB, 2, 2, 1, 1);
+    asm_cmd(JNE, 0, 2, 0, loop);
+    asm_cmd(ST,  0, 3, 1, CHECKSUM);
+
+    // 2) blend, r2 = words left, r3 = A word, r4 = B word, r7 = OUT word
+    asm_cmd(ADD, 2, 1, 0, WORDS);
+    loop = pc;
+    asm_cmd(ADD, 5, 2, 1, A - 1);
+    asm_cmd(LD,  3, 0, 5, 0);
+    asm_cmd(ADD, 5, 2, 1, B - 1);
+    asm_cmd(LD,  4, 0, 5, 0);
+    if (simd) {
+        asm_cmd(SIMD, 7, 3, 4, SIMD_ADDUSB);
+    }
+    else {
+        for (k = 0; k < 4; k++) {
+            if (k) {
+                asm_cmd(RSF, 5, 3, 1, 8 * k);
+                asm_cmd(AND, 5, 5, 1, 0xFF);
+                asm_cmd(RSF, 6, 4, 1, 8 * k);
+                asm_cmd(AND, 6, 6, 1, 0xFF);
+            }
+            else {
+                asm_cmd(AND, 5, 3, 1, 0xFF);
+                asm_cmd(AND, 6, 4, 1, 0xFF);
+            }
+            // saturate without a branch: carry out of the byte -> 0xff
+            asm_cmd(ADD, 5, 5, 6, 0);
+            asm_cmd(RSF, 6, 5, 1, 8);
+            asm_cmd(SUB, 6, 0, 6, 0);
+            asm_cmd(OR,  5, 5, 6, 0);
+            asm_cmd(AND, 5, 5, 1, 0xFF);
+            if (k) {
+                asm_cmd(LSF, 5, 5, 1, 8 * k);
+                asm_cmd(OR,  7, 7, 5, 0);
+            }
+            else {
+                asm_cmd(ADD, 7, 5, 0, 0);
+            }
+        }
+    }
+    asm_cmd(ADD, 5, 2, 1, OUT - 1);
+    asm_cmd(ST,  0, 7, 5, 0);
+    asm_cmd(SUB, 2, 2, 1, 1);
+    asm_cmd(JNE, 0, 2, 0, loop);
+
+    // check the checksum
+    asm_cmd(LD,  3, 0, 1, CHECKSUM);
+    asm_cmd(LD,  4, 0, 1, EXPECTED);
+    fail = pc;
+    asm_cmd(JNE, 0, 3, 4, 0);
+    asm_cmd(ADD, 5, 1, 0, 1);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+    mem[fail] |= pc;
+    asm_cmd(ADD, 5, 1, 0, 2);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    FILE *fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i < OPS + SIMD_OPS; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    int simd = 1;
+
+    if (argc == 3 && !strcmp(argv[2], "scalar"))
+        simd = 0;
+    else if (argc != 2 && !(argc == 3 && !strcmp(argv[2], "simd"))) {
+        fprintf(stderr, "usage: asm <output_sram.txt> [simd|scalar]\n");
+        return 1;
+    }
+    assemble_program(argv[1], simd);
+    printf("SP assembler generated %s (%s byte kernels)\n", argv[1], simd ? "SIMD" : "scalar");
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h> 
@@ -73,6 +74,9 @@ typedef struct sp_registers_s {
     int dma_dst;      // destination base address
     int dma_len;      // total words to copy
     int dma_count;    // how many words copied so far
+
+	// clocks the MUL/DIV/MOD in EXEC0 has spent in the multiply/divide unit
+	int mdu_count;
 } sp_registers_t;
 
 
@@ -116,17 +120,130 @@ static void sp_reset(sp_t *sp)
 #define DMA_START   10   // R[src0] = src addr, R[src1] = dst addr, imm = length
 #define DMA_STATUS  11   // R[dst] := (dma_state != 0)
 ///////////////////////
+#define CPUID 14	// R[dst] := core id (imm 0) or number of cores (imm 1)
+#define FAA 15		// R[dst] := MEM[R[src1]], MEM[R[src1]] += R[src0], atomically
 #define JLT 16
 #define JLE 17
 #define JEQ 18
 #define JNE 19
 #define JIN 20
+#define CAS 21		// R[dst] := MEM[R[src1]], MEM[R[src1]] := R[src0] if it was R[dst], atomically
+#define MUL 22		// R[dst] := R[src0] * R[src1], low 32 bits
+#define DIV 23		// R[dst] := R[src0] / R[src1], signed, -1 on division by zero
 #define HLT 24
+#define MOD 25		// R[dst] := R[src0] % R[src1], signed, R[src0] on division by zero
+#define SIMD 26		// R[dst] := packed operation imm[3:0] on R[src0], R[src1]
+
+// SIMD operations (imm[3:0]), 4x8 bit unsigned or 2x16 bit signed lanes
+#define SIMD_ADDB	0
+#define SIMD_SUBB	1
+#define SIMD_ADDUSB	2
+#define SIMD_MINUB	3
+#define SIMD_MAXUB	4
+#define SIMD_ADDH	5
+#define SIMD_SUBH	6
+#define SIMD_ADDSH	7
+#define SIMD_MINH	8
+#define SIMD_MAXH	9
+#define SIMD_SHUFB	10	// byte i := R[src0] byte imm[9+2i:8+2i]
+#define SIMD_SUMB	11	// R[src1] + the four bytes of R[src0]
+
+/*
+ * the iterative multiply/divide unit keeps the core in EXEC0 for
+ * SP_MUL_LATENCY / SP_DIV_LATENCY clocks
+ */
+#ifndef SP_MUL_LATENCY
+#define SP_MUL_LATENCY	3
+#endif
+#ifndef SP_DIV_LATENCY
+#define SP_DIV_LATENCY	16
+#endif
 
 static char opcode_name[32][4] = {"ADD", "SUB", "LSF", "RSF", "AND", "OR", "XOR", "LHI",
-				 "LD", "ST", "U", "U", "U", "U", "U", "U",
-				 "JLT", "JLE", "JEQ", "JNE", "JIN", "U", "U", "U",
-				 "HLT", "U", "U", "U", "U", "U", "U", "U"};
+				 "LD", "ST", "U", "U", "U", "U", "CID", "FAA",
+				 "JLT", "JLE", "JEQ", "JNE", "JIN", "CAS", "MUL", "DIV",
+				 "HLT", "MOD", "SMD", "U", "U", "U", "U", "U"};
+
+/*
+ * atomics by address: operations, CAS failures (software retries) and
+ * clocks spent waiting in EXEC0 for the DMA engine to release the sram
+ */
+#define SP_AMO_STATS 16
+
+typedef struct sp_amo_stat_s {
+	int addr;
+	i64 ops;
+	i64 cas_fails;
+	i64 wait_cycles;
+} sp_amo_stat_t;
+
+static sp_amo_stat_t sp_amo_stats[SP_AMO_STATS];
+static int sp_nr_amo_stats;
+
+static sp_amo_stat_t *sp_amo_stat(int addr)
+{
+	int i;
+
+	for (i = 0; i < sp_nr_amo_stats; i++)
+		if (sp_amo_stats[i].addr == addr)
+			return &sp_amo_stats[i];
+	if (sp_nr_amo_stats == SP_AMO_STATS)
+		return &sp_amo_stats[SP_AMO_STATS - 1];
+	sp_amo_stats[sp_nr_amo_stats].addr = addr;
+	return &sp_amo_stats[sp_nr_amo_stats++];
+}
+
+static int sp_muldiv(int opcode, int a, int b)
+{
+	if (opcode == MUL)
+		return (int)((uint32_t)a * (uint32_t)b);
+	if (b == 0)
+		return (opcode == DIV) ? -1 : a;
+	if (a == INT32_MIN && b == -1)
+		return (opcode == DIV) ? a : 0;
+	return (opcode == DIV) ? a / b : a % b;
+}
+
+static int sp_simd(int imm, int a, int b)
+{
+	uint32_t res = 0;
+	int op = imm & 0xF;
+	int i, x, y, r;
+
+	if (op <= SIMD_MAXUB) {
+		for (i = 0; i < 32; i += 8) {
+			x = ((uint32_t)a >> i) & 0xFF;
+			y = ((uint32_t)b >> i) & 0xFF;
+			switch (op) {
+			case SIMD_ADDB:   r = x + y; break;
+			case SIMD_SUBB:   r = x - y; break;
+			case SIMD_ADDUSB: r = (x + y > 0xFF) ? 0xFF : x + y; break;
+			case SIMD_MINUB:  r = (x < y) ? x : y; break;
+			default:          r = (x > y) ? x : y; break;
+			}
+			res |= (uint32_t)(r & 0xFF) << i;
+		}
+	} else if (op <= SIMD_MAXH) {
+		for (i = 0; i < 32; i += 16) {
+			x = (int16_t)((uint32_t)a >> i);
+			y = (int16_t)((uint32_t)b >> i);
+			switch (op) {
+			case SIMD_ADDH:  r = x + y; break;
+			case SIMD_SUBH:  r = x - y; break;
+			case SIMD_ADDSH: r = (x + y > INT16_MAX) ? INT16_MAX : (x + y < INT16_MIN) ? INT16_MIN : x + y; break;
+			case SIMD_MINH:  r = (x < y) ? x : y; break;
+			default:         r = (x > y) ? x : y; break;
+			}
+			res |= (uint32_t)(r & 0xFFFF) << i;
+		}
+	} else if (op == SIMD_SHUFB) {
+		for (i = 0; i < 4; i++)
+			res |= (((uint32_t)a >> (8 * ((imm >> (8 + 2 * i)) & 3))) & 0xFF) << (8 * i);
+	} else if (op == SIMD_SUMB) {
+		res = b + (a & 0xFF) + ((a >> 8) & 0xFF) + ((a >> 16) & 0xFF) + (((uint32_t)a >> 24) & 0xFF);
+	}
+	return (int)res;
+}
 
 static void dump_sram(sp_t *sp)
 {
@@ -300,6 +417,33 @@ static void sp_ctl(sp_t *sp)
 			case ST:
 				sprn->aluout = spro->alu1;  // Compute effective address. value to be saved is the the value of register
 				break;
+			case CPUID:
+				sprn->aluout = (spro->immediate == 1) ? 1 : 0;  // single core
+				break;
+			case MUL:
+			case DIV:
+			case MOD:
+				if (spro->mdu_count + 1 < (spro->opcode == MUL ? SP_MUL_LATENCY : SP_DIV_LATENCY)) {
+					sprn->mdu_count = spro->mdu_count + 1;
+					sprn->ctl_state = CTL_STATE_EXEC0;
+					return;
+				}
+				sprn->mdu_count = 0;
+				sprn->aluout = sp_muldiv(spro->opcode, spro->alu0, spro->alu1);
+				break;
+			case SIMD:
+				sprn->aluout = sp_simd(spro->immediate, spro->alu0, spro->alu1);
+				break;
+			case FAA:
+			case CAS:
+				// the read of the read-modify-write, never in the middle of a DMA transfer
+				if (spro->dma_state != 0) {
+					sp_amo_stat(spro->alu1 & 0xFFFF)->wait_cycles++;
+					sprn->ctl_state = CTL_STATE_EXEC0;
+					return;
+				}
+				llsim_mem_read(sp->sram, spro->alu1);
+				break;
 			default:
 				sprn->aluout = 0;
 				break;
@@ -372,6 +516,46 @@ static void sp_ctl(sp_t *sp)
                 sprn->pc = (spro->pc + 1) & 0xFFFF; //fail safe           
 				break;
                 
+            // --- Multiply/Divide and SIMD Instructions ---
+            case MUL:
+            case DIV:
+            case MOD:
+            case SIMD:
+                if (spro->dst != 0)
+                    sprn->r[spro->dst] = spro->aluout;
+                sprn->pc = (spro->pc + 1) & 0xFFFF;
+                break;
+
+            // --- Atomic Instructions ---
+            case CPUID:
+                if (spro->dst != 0)
+                    sprn->r[spro->dst] = spro->aluout;
+                sprn->pc = (spro->pc + 1) & 0xFFFF;
+                break;
+
+            case FAA:
+            case CAS: {
+                int old = llsim_mem_extract_dataout(sp->sram, 31, 0);
+                sp_amo_stat_t *st = sp_amo_stat(spro->alu1 & 0xFFFF);
+
+                st->ops++;
+                if (spro->opcode == FAA) {
+                    llsim_mem_set_datain(sp->sram, old + spro->alu0, 31, 0);
+                    llsim_mem_write(sp->sram, spro->alu1);
+                }
+                else if (old == spro->r[spro->dst]) {
+                    llsim_mem_set_datain(sp->sram, spro->alu0, 31, 0);
+                    llsim_mem_write(sp->sram, spro->alu1);
+                }
+                else {
+                    st->cas_fails++;
+                }
+                if (spro->dst != 0)
+                    sprn->r[spro->dst] = old;
+                sprn->pc = (spro->pc + 1) & 0xFFFF;
+                break;
+            }
+
             // --- Store Instruction ---
             case ST:
                 // ST writes R[src0] to memory at the address in R[src1].
@@ -426,6 +610,9 @@ static void sp_ctl(sp_t *sp)
             // --- Halt Instruction ---
             case HLT:
                 dump_sram(sp);  // Dump SRAM contents on halt.
+                for (i = 0; i < sp_nr_amo_stats; i++)
+                    llsim_printf("amo addr %d ops %lld cas_fails %lld wait_cycles %lld\n", sp_amo_stats[i].addr,
+                        sp_amo_stats[i].ops, sp_amo_stats[i].cas_fails, sp_amo_stats[i].wait_cycles);
                 sprn->ctl_state = CTL_STATE_IDLE;
                 llsim_stop();
                 break;
@@ -555,6 +742,7 @@ static void sp_register_all_registers(sp_t *sp)
     llsim_register_register("sp", "dma_dst",   16, 0, &spro->dma_dst,   &sprn->dma_dst);
     llsim_register_register("sp", "dma_len",   32, 0, &spro->dma_len,   &sprn->dma_len);
     llsim_register_register("sp", "dma_count", 32, 0, &spro->dma_count, &sprn->dma_count);
+	llsim_register_register("sp", "mdu_count", 5, 0, &spro->mdu_count, &sprn->mdu_count);
 
 }
 
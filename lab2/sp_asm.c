@@ -0,0 +1,786 @@
+/*
+ * SP ASM: Text Assembler
+ *
+ * Assembles a .s source into a memory image (one %08x word per line, like
+ * the asm_cmd() generators write) and a symbol map for the profilers.
+ *
+ *   usage: sp_asm [-s] prog.s prog.bin      (also writes prog.map)
+ *
+ * Source format, one statement per line, ';' or '//' start a comment:
+ *
+ *   loop:   ADD  r2, r2, r1, -1        ; dst, src0, src1, imm as in asm_cmd()
+ *           JNE  r0, r2, r0, loop      ; r1 as a source takes the immediate
+ *           HLT                        ; missing operands are r0 / 0
+ *   .org  1000                         ; go on at address 1000
+ *   data:   .word 3000, data + 1       ; data words
+ *   .equ  N, 50                        ; constant
+ *   .macro JMP target                  ; \target is replaced by the argument,
+ *           JEQ  r0, r0, r0, \target   ; \@ by a number unique to each
+ *   .endm                              ; expansion (for local labels)
+ *
+ * Immediates are sums and differences of numbers (decimal, 0x hex), labels,
+ * constants and '.' (the address of the statement). Labels may be used
+ * before they are defined, .org and .equ operands may not.
+ *
+ * The map lists every label as "address name", sorted by address.
+ *
+ * -s runs a list scheduler over the assembled code: inside each basic block
+ * independent instructions are reordered so that the consumer of a load
+ * doesn't sit right behind it (the load-use stall of the pipelined core).
+ * Labels, branch and LOOP targets start blocks and keep their address, and
+ * control flow, DMA, atomics and instructions using '.' stay in place. The
+ * static count of load-use pairs is reported before and after.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define MAX_LINE       256
+#define MAX_NAME       64
+#define MAX_LINES      65536
+#define MAX_SYMBOLS    4096
+#define MAX_MACROS     256
+#define MAX_PARAMS     8
+#define MAX_DEPTH      16
+#define MAX_BLOCK      256
+
+#define ADD         0
+#define XOR         6
+#define LHI         7
+#define LD          8
+#define ST          9
+#define CPUID       14
+#define FAA         15
+#define JLT         16
+#define JNE         19
+#define JIN         20
+#define CAS         21
+#define MUL         22
+#define DIV         23
+#define MOD         25
+#define SIMD        26
+#define LOOP        27
+#define LDI         28
+#define STI         29
+
+// result latencies of the pipelined core (default configuration)
+#define LOAD_LATENCY   2
+#define MUL_LATENCY    3
+#define DIV_LATENCY    16
+
+static const char *mnemonics[32] = {
+    "ADD", "SUB", "LSF", "RSF", "AND", "OR", "XOR", "LHI",
+    "LD", "ST", "DMA_START", "DMA_STATUS", "DMA_DOORBELL", "WFE", "CPUID", "FAA",
+    "JLT", "JLE", "JEQ", "JNE", "JIN", "CAS", "MUL", "DIV",
+    "HLT", "MOD", "SIMD", "LOOP", "LDI", "STI", NULL, NULL
+};
+
+typedef struct {
+    char text[MAX_LINE];
+    int line;               // line in the source file
+} line_t;
+
+typedef struct {
+    char name[MAX_NAME];
+    int value;
+    int label;              // address, or .equ constant
+} symbol_t;
+
+typedef struct {
+    char name[MAX_NAME];
+    char params[MAX_PARAMS][MAX_NAME];
+    int nr_params;
+    int first, last;        // body lines in src[]
+} macro_t;
+
+static const char *src_name;
+static line_t src[MAX_LINES], prog[MAX_LINES];
+static int nr_src, nr_prog;
+static symbol_t symbols[MAX_SYMBOLS];
+static int nr_symbols;
+static macro_t macros[MAX_MACROS];
+static int nr_macros, nr_expansions;
+
+static unsigned int mem[MEM_SIZE];
+static unsigned char used[MEM_SIZE];
+static unsigned char is_code[MEM_SIZE];
+static unsigned char pinned[MEM_SIZE];  // encoding depends on its address
+static int used_here;                   // the expression referred to '.'
+
+static int cur_line;        // for error messages
+static int pass;
+
+static void error(const char *msg, const char *arg)
+{
+    fprintf(stderr, "%s:%d: error: %s%s%s\n", src_name, cur_line, msg, arg ? " " : "", arg ? arg : "");
+    exit(1);
+}
+
+// case-insensitive compare for mnemonics, directives and macro names
+static int same_name(const char *a, const char *b)
+{
+    while (*a && tolower((unsigned char)*a) == tolower((unsigned char)*b))
+        a++, b++;
+    return *a == *b;
+}
+
+static char *skip_space(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    return s;
+}
+
+static void trim(char *s)
+{
+    int n = strlen(s);
+
+    while (n && isspace((unsigned char)s[n - 1]))
+        s[--n] = 0;
+}
+
+static int is_ident(int c, int first)
+{
+    return isalpha(c) || c == '_' || c == '.' || (!first && isdigit(c));
+}
+
+// copy an identifier at s to name, return the first character after it
+static char *get_ident(char *s, char *name)
+{
+    int n = 0;
+
+    if (!is_ident((unsigned char)*s, 1))
+        return NULL;
+    while (is_ident((unsigned char)*s, 0)) {
+        if (n == MAX_NAME - 1)
+            error("name too long", NULL);
+        name[n++] = *s++;
+    }
+    name[n] = 0;
+    return s;
+}
+
+static symbol_t *find_symbol(const char *name)
+{
+    int i;
+
+    for (i = 0; i < nr_symbols; i++)
+        if (!strcmp(symbols[i].name, name))
+            return &symbols[i];
+    return NULL;
+}
+
+static void define_symbol(const char *name, int value, int label)
+{
+    if (find_symbol(name))
+        error("symbol defined twice:", name);
+    if (nr_symbols == MAX_SYMBOLS)
+        error("too many symbols", NULL);
+    strcpy(symbols[nr_symbols].name, name);
+    symbols[nr_symbols].value = value;
+    symbols[nr_symbols].label = label;
+    nr_symbols++;
+}
+
+static macro_t *find_macro(const char *name)
+{
+    int i;
+
+    for (i = 0; i < nr_macros; i++)
+        if (same_name(macros[i].name, name))
+            return &macros[i];
+    return NULL;
+}
+
+// Expression: [-] term { (+|-) term }, a term is a number, a symbol or '.'.
+// In pass 1 (and always when "defined" is set) every symbol must be known.
+static int eval(char *s, int here, int defined)
+{
+    char name[MAX_NAME], *end;
+    int value = 0, sign = 1, term;
+    symbol_t *sym;
+
+    s = skip_space(s);
+    if (!*s)
+        error("missing expression", NULL);
+    for (;;) {
+        s = skip_space(s);
+        if (*s == '-') {
+            sign = -sign;
+            s = skip_space(s + 1);
+        }
+        if (isdigit((unsigned char)*s)) {
+            term = (int)strtol(s, &end, 0);
+            s = end;
+        }
+        else if (*s == '.' && !is_ident((unsigned char)s[1], 0)) {
+            term = here;
+            used_here = 1;
+            s++;
+        }
+        else if ((end = get_ident(s, name))) {
+            s = end;
+            sym = find_symbol(name);
+            if (sym)
+                term = sym->value;
+            else if (pass == 2 || defined)
+                error("undefined symbol", name);
+            else
+                term = 0;
+        }
+        else {
+            error("bad expression", s);
+        }
+        value += sign * term;
+        s = skip_space(s);
+        if (!*s)
+            return value;
+        if (*s == '+')
+            sign = 1;
+        else if (*s == '-')
+            sign = -1;
+        else
+            error("bad expression", s);
+        s++;
+    }
+}
+
+// split "a, b, c" in place, return the number of operands
+static int split_operands(char *s, char **ops, int max)
+{
+    int n = 0, i;
+
+    s = skip_space(s);
+    if (!*s)
+        return 0;
+    for (;;) {
+        if (n == max)
+            error("too many operands", NULL);
+        ops[n++] = s;
+        s = strchr(s, ',');
+        if (!s)
+            break;
+        *s++ = 0;
+        s = skip_space(s);
+    }
+    for (i = 0; i < n; i++)
+        trim(ops[i]);
+    return n;
+}
+
+static int reg_operand(char *s)
+{
+    if ((s[0] == 'r' || s[0] == 'R') && s[1] >= '0' && s[1] <= '7' && !s[2])
+        return s[1] - '0';
+    error("expected a register r0..r7, got", s);
+    return 0;
+}
+
+static void emit(int addr, unsigned int word)
+{
+    if (addr < 0 || addr >= MEM_SIZE)
+        error("address out of memory", NULL);
+    if (pass == 2) {
+        if (used[addr])
+            error("address written twice", NULL);
+        used[addr] = 1;
+        mem[addr] = word;
+    }
+}
+
+static int encode(char *mnemonic, char *args, int here)
+{
+    char *ops[4];
+    int opcode, n, i, reg[3] = { 0, 0, 0 }, imm = 0;
+
+    for (opcode = 0; opcode < 32; opcode++)
+        if (mnemonics[opcode] && same_name(mnemonics[opcode], mnemonic))
+            break;
+    if (opcode == 32)
+        error("unknown instruction", mnemonic);
+
+    n = split_operands(args, ops, 4);
+    for (i = 0; i < n && i < 3; i++)
+        reg[i] = reg_operand(ops[i]);
+    if (n == 4)
+        imm = eval(ops[3], here, 0);
+    if (pass == 2 && (imm < -32768 || imm > 65535))
+        error("immediate out of 16 bits:", ops[3]);
+
+    return ((opcode & 0x1F) << 25)
+         | ((reg[0]  & 0x07) << 22)
+         | ((reg[1]  & 0x07) << 19)
+         | ((reg[2]  & 0x07) << 16)
+         | (imm       & 0xFFFF);
+}
+
+// one statement of the expanded program, returns the next address
+static int assemble_line(const char *text, int here)
+{
+    char buf[MAX_LINE], name[MAX_NAME], *s = buf, *end, *ops[MAX_PARAMS];
+    int n, i;
+
+    strcpy(buf, text);   // operands are split in place, both passes need the line
+
+    // labels
+    for (;;) {
+        s = skip_space(s);
+        end = get_ident(s, name);
+        if (!end || *skip_space(end) != ':')
+            break;
+        if (pass == 1)
+            define_symbol(name, here, 1);
+        s = skip_space(end) + 1;
+    }
+    if (!*s)
+        return here;
+
+    end = get_ident(s, name);
+    if (!end)
+        error("syntax error:", s);
+
+    if (same_name(name, ".org"))
+        return eval(end, here, 1);
+
+    if (same_name(name, ".equ")) {
+        n = split_operands(end, ops, 2);
+        if (n != 2 || !get_ident(ops[0], name))
+            error("usage: .equ name, value", NULL);
+        if (pass == 1)
+            define_symbol(name, eval(ops[1], here, 1), 0);
+        return here;
+    }
+
+    if (same_name(name, ".word")) {
+        n = split_operands(end, ops, MAX_PARAMS);
+        for (i = 0; i < n; i++, here++)
+            emit(here, (unsigned int)eval(ops[i], here, 0));
+        return here;
+    }
+
+    used_here = 0;
+    emit(here, encode(name, end, here));
+    if (pass == 2) {
+        is_code[here] = 1;
+        pinned[here] = used_here;
+    }
+    return here + 1;
+}
+
+// replace \param and \@ in a macro body line
+static void substitute(char *out, const char *in, macro_t *m, char **args, int nr_args, int id)
+{
+    char name[MAX_NAME], buf[MAX_LINE];
+    int n = 0, i, len;
+
+    while (*in) {
+        const char *val = NULL;
+
+        if (in[0] == '\\' && in[1] == '@') {
+            sprintf(buf, "%d", id);
+            val = buf;
+            in += 2;
+        }
+        else if (in[0] == '\\' && get_ident((char *)in + 1, name)) {
+            for (i = 0; i < m->nr_params; i++)
+                if (!strcmp(m->params[i], name))
+                    break;
+            if (i == m->nr_params)
+                error("unknown macro parameter", name);
+            val = (i < nr_args) ? args[i] : "";
+            in += 1 + strlen(name);
+        }
+        if (val) {
+            len = strlen(val);
+            if (n + len >= MAX_LINE)
+                error("macro expansion too long", NULL);
+            memcpy(out + n, val, len);
+            n += len;
+            continue;
+        }
+        if (n == MAX_LINE - 1)
+            error("macro expansion too long", NULL);
+        out[n++] = *in++;
+    }
+    out[n] = 0;
+}
+
+static void add_prog_line(const char *text, int line)
+{
+    if (nr_prog == MAX_LINES)
+        error("program too long", NULL);
+    strcpy(prog[nr_prog].text, text);
+    prog[nr_prog].line = line;
+    nr_prog++;
+}
+
+// copy a source line to the program, expanding a macro call
+static void expand(char *text, int line, int depth)
+{
+    char name[MAX_NAME], copy[MAX_LINE], body[MAX_LINE], *s, *end, *args[MAX_PARAMS];
+    macro_t *m;
+    int n, i, id;
+
+    cur_line = line;
+    strcpy(copy, text);
+    s = skip_space(copy);
+
+    // leading labels stay on their own line
+    while ((end = get_ident(s, name)) && *skip_space(end) == ':') {
+        char label[MAX_LINE];
+
+        sprintf(label, "%s:", name);
+        add_prog_line(label, line);
+        s = skip_space(skip_space(end) + 1);
+    }
+
+    end = get_ident(s, name);
+    if (!end || !(m = find_macro(name))) {
+        add_prog_line(s, line);
+        return;
+    }
+    if (depth == MAX_DEPTH)
+        error("macros nested too deep:", name);
+
+    n = split_operands(end, args, MAX_PARAMS);
+    if (n > m->nr_params)
+        error("too many macro arguments:", name);
+    id = nr_expansions++;
+    for (i = m->first; i < m->last; i++) {
+        cur_line = src[i].line;
+        substitute(body, src[i].text, m, args, n, id);
+        expand(body, src[i].line, depth + 1);
+    }
+}
+
+static void read_source(void)
+{
+    char buf[MAX_LINE], *s;
+    FILE *fp = fopen(src_name, "r");
+    int line = 0;
+
+    if (!fp) {
+        printf("couldn't open file %s\n", src_name);
+        exit(1);
+    }
+    while (fgets(buf, sizeof(buf), fp)) {
+        cur_line = ++line;
+        if (!strchr(buf, '\n') && !feof(fp))
+            error("line too long", NULL);
+        if ((s = strchr(buf, ';')))
+            *s = 0;
+        if ((s = strstr(buf, "//")))
+            *s = 0;
+        trim(buf);
+        if (nr_src == MAX_LINES)
+            error("source too long", NULL);
+        strcpy(src[nr_src].text, buf);
+        src[nr_src].line = line;
+        nr_src++;
+    }
+    fclose(fp);
+}
+
+// collect .macro ... .endm blocks and expand everything else into prog[]
+static void preprocess(void)
+{
+    char name[MAX_NAME], *s, *ops[MAX_PARAMS + 1];
+    macro_t *m = NULL;
+    int i, n, k;
+
+    for (i = 0; i < nr_src; i++) {
+        cur_line = src[i].line;
+        s = skip_space(src[i].text);
+        if (get_ident(s, name) && same_name(name, ".endm")) {
+            if (!m)
+                error(".endm without .macro", NULL);
+            m->last = i;
+            m = NULL;
+        }
+        else if (get_ident(s, name) && same_name(name, ".macro")) {
+            char line[MAX_LINE];
+
+            if (m)
+                error("nested .macro", NULL);
+            if (nr_macros == MAX_MACROS)
+                error("too many macros", NULL);
+            strcpy(line, skip_space(s + 6));
+            m = &macros[nr_macros++];
+            s = get_ident(line, m->name);
+            if (!s)
+                error("usage: .macro name [param, ...]", NULL);
+            if (find_macro(m->name) != m || find_symbol(m->name))
+                error("macro defined twice:", m->name);
+            n = split_operands(s, ops, MAX_PARAMS);
+            for (k = 0; k < n; k++)
+                if (!get_ident(ops[k], m->params[k]) || *get_ident(ops[k], m->params[k]))
+                    error("bad macro parameter", ops[k]);
+            m->nr_params = n;
+            m->first = i + 1;
+        }
+    }
+    if (m)
+        error(".macro without .endm", m->name);
+
+    m = NULL;
+    for (i = 0; i < nr_src; i++) {
+        s = skip_space(src[i].text);
+        if (get_ident(s, name) && same_name(name, ".macro"))
+            m = find_macro(get_ident(skip_space(s + 6), name) ? name : "");
+        if (m) {
+            if (i == m->last)
+                m = NULL;
+            continue;
+        }
+        expand(src[i].text, src[i].line, 0);
+    }
+}
+
+#define OP(inst)    ((int)((inst) >> 25) & 0x1F)
+#define DST(inst)   ((int)((inst) >> 22) & 0x07)
+#define SRC0(inst)  ((int)((inst) >> 19) & 0x07)
+#define SRC1(inst)  ((int)((inst) >> 16) & 0x07)
+#define IMM(inst)   ((int)(inst) & 0xFFFF)
+
+// Registers (r2..r7 bit masks) an instruction reads and writes, and whether
+// it loads (1) or stores (2). Returns 0 for what has to stay in place.
+static int inst_deps(unsigned int inst, int *rd, int *wr, int *mem_op)
+{
+    int d = 1 << DST(inst), s0 = 1 << SRC0(inst), s1 = 1 << SRC1(inst);
+
+    *rd = *wr = *mem_op = 0;
+    switch (OP(inst)) {
+    case LD:  *rd = s1;      *wr = d;      *mem_op = 1; break;
+    case LDI: *rd = s1;      *wr = d | s1; *mem_op = 1; break;
+    case ST:  *rd = s0 | s1;               *mem_op = 2; break;
+    case STI: *rd = s0 | s1; *wr = s1;     *mem_op = 2; break;
+    case CPUID: *wr = d; break;
+    case LHI: case MUL: case DIV: case MOD: case SIMD:
+        *rd = s0 | s1;
+        *wr = d;
+        break;
+    default:
+        if (OP(inst) > XOR)
+            return 0;
+        *rd = s0 | s1;
+        *wr = d;
+        break;
+    }
+    *rd &= 0xFC;
+    *wr &= 0xFC;
+    return 1;
+}
+
+static int latency(unsigned int inst)
+{
+    switch (OP(inst)) {
+    case LD: case LDI: return LOAD_LATENCY;
+    case MUL: return MUL_LATENCY;
+    case DIV: case MOD: return DIV_LATENCY;
+    default: return 1;
+    }
+}
+
+// b names register d as a source (the fields detect_hazards compares)
+static int names_reg(unsigned int b, int d)
+{
+    return d >= 2 && (SRC0(b) == d || SRC1(b) == d || (OP(b) == CAS && DST(b) == d));
+}
+
+// The pipelined core stalls b for a clock right behind a load of its source
+static int load_use(unsigned int a, unsigned int b)
+{
+    int op = OP(a);
+
+    return (op == LD || op == LDI || op == FAA || op == CAS) && names_reg(b, DST(a));
+}
+
+static int count_stalls(void)
+{
+    int i, n = 0;
+
+    for (i = 0; i + 1 < MEM_SIZE; i++)
+        if (is_code[i] && is_code[i + 1] && load_use(mem[i], mem[i + 1]))
+            n++;
+    return n;
+}
+
+// list-schedule the movable instructions at [first, first + n)
+static void schedule_block(int first, int n)
+{
+    unsigned int code[MAX_BLOCK];
+    int rd[MAX_BLOCK], wr[MAX_BLOCK], mo[MAX_BLOCK], prio[MAX_BLOCK], preds[MAX_BLOCK];
+    unsigned char dep[MAX_BLOCK][MAX_BLOCK], done[MAX_BLOCK];
+    unsigned int prev = (first > 0 && is_code[first - 1]) ? mem[first - 1] : 0;
+    unsigned int next = (first + n < MEM_SIZE && is_code[first + n]) ? mem[first + n] : 0;
+    int i, j, k, best, score, best_score;
+
+    for (i = 0; i < n; i++) {
+        code[i] = mem[first + i];
+        inst_deps(code[i], &rd[i], &wr[i], &mo[i]);
+        preds[i] = done[i] = 0;
+    }
+
+    // i before j: RAW, WAR, WAW, and stores ordered with all memory accesses
+    for (j = 0; j < n; j++) {
+        for (i = 0; i < j; i++) {
+            dep[i][j] = (wr[i] & rd[j]) || (rd[i] & wr[j]) || (wr[i] & wr[j]) ||
+                (mo[i] && mo[j] && (mo[i] == 2 || mo[j] == 2));
+            preds[j] += dep[i][j];
+        }
+    }
+
+    // priority: the clocks a result is late (latency beyond 1) on the
+    // longest path to the end of the block or the instruction after it, so
+    // code without long latency results keeps its order
+    for (i = n - 1; i >= 0; i--) {
+        int late = latency(code[i]) - 1;
+
+        prio[i] = names_reg(next, DST(code[i])) && (wr[i] & (1 << DST(code[i]))) ? late : 0;
+        for (j = i + 1; j < n; j++) {
+            int p = ((wr[i] & rd[j]) ? late : 0) + prio[j];
+
+            if (dep[i][j] && p > prio[i])
+                prio[i] = p;
+        }
+    }
+
+    for (k = 0; k < n; k++) {
+        best = -1;
+        best_score = 0;
+        for (i = 0; i < n; i++) {
+            if (done[i] || preds[i])
+                continue;
+            // no stall behind the previous slot first, then priority, then
+            // the original order
+            score = prio[i] + (load_use(prev, code[i]) ? 0 : 65536);
+            if (best < 0 || score > best_score) {
+                best = i;
+                best_score = score;
+            }
+        }
+        done[best] = 1;
+        for (j = best + 1; j < n; j++)
+            preds[j] -= dep[best][j];
+        mem[first + k] = prev = code[best];
+    }
+}
+
+static void schedule_program(void)
+{
+    static unsigned char leader[MEM_SIZE + 1];
+    int i, first, before = count_stalls();
+
+    for (i = 0; i < nr_symbols; i++)
+        if (symbols[i].label && symbols[i].value >= 0 && symbols[i].value < MEM_SIZE)
+            leader[symbols[i].value] = 1;
+    for (i = 0; i < MEM_SIZE; i++) {
+        if (!is_code[i])
+            continue;
+        switch (OP(mem[i])) {
+        case LOOP:
+            leader[(IMM(mem[i]) + 1) & 0xFFFF] = 1;
+            leader[i + 1] = 1;
+            break;
+        default:
+            if (OP(mem[i]) >= JLT && OP(mem[i]) <= JNE)
+                leader[IMM(mem[i])] = 1;
+            if (OP(mem[i]) >= JLT && OP(mem[i]) <= JIN)
+                leader[i + 1] = 1;
+            break;
+        }
+    }
+
+    // blocks: runs of movable instructions that don't cross a leader
+    for (first = i = 0; i <= MEM_SIZE; i++) {
+        int rd, wr, mo;
+        int movable = i < MEM_SIZE && is_code[i] && !pinned[i] && inst_deps(mem[i], &rd, &wr, &mo);
+
+        if (!movable || leader[i] || i - first == MAX_BLOCK) {
+            if (i - first > 1)
+                schedule_block(first, i - first);
+            first = movable ? i : i + 1;
+        }
+    }
+    printf("scheduler: %d load-use stalls before, %d after\n", before, count_stalls());
+}
+
+static int compare_symbols(const void *a, const void *b)
+{
+    const symbol_t *x = a, *y = b;
+
+    return (x->value != y->value) ? x->value - y->value : strcmp(x->name, y->name);
+}
+
+static void write_output(const char *outname)
+{
+    char mapname[1024];
+    char *dot;
+    FILE *fp;
+    int i, last = -1;
+
+    for (i = 0; i < MEM_SIZE; i++)
+        if (used[i])
+            last = i;
+
+    fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i <= last; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+
+    snprintf(mapname, sizeof(mapname) - 4, "%s", outname);
+    dot = strrchr(mapname, '.');
+    if (dot && !strchr(dot, '/'))
+        *dot = 0;
+    strcat(mapname, ".map");
+    fp = fopen(mapname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", mapname);
+        exit(1);
+    }
+    qsort(symbols, nr_symbols, sizeof(symbols[0]), compare_symbols);
+    for (i = 0; i < nr_symbols; i++)
+        if (symbols[i].label)
+            fprintf(fp, "%d %s\n", symbols[i].value, symbols[i].name);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    int i, here, sched = 0;
+
+    if (argc == 4 && !strcmp(argv[1], "-s")) {
+        sched = 1;
+        argv++;
+        argc--;
+    }
+    if (argc != 3) {
+        fprintf(stderr, "usage: sp_asm [-s] <program.s> <output_sram.bin>\n");
+        return 1;
+    }
+    src_name = argv[1];
+    read_source();
+    preprocess();
+
+    for (pass = 1; pass <= 2; pass++) {
+        here = 0;
+        for (i = 0; i < nr_prog; i++) {
+            cur_line = prog[i].line;
+            here = assemble_line(prog[i].text, here);
+        }
+    }
+
+    if (sched)
+        schedule_program();
+    write_output(argv[2]);
+    printf("SP assembler generated %s from %s\n", argv[2], argv[1]);
+    return 0;
+}
@@ -0,0 +1,494 @@
+/*
+ * SP LAYOUT: Profile-Guided Code Layout
+ *
+ * FETCH0 of the pipelined core predicts fall-through, so every taken
+ * branch costs a flush. This tool reorders the basic blocks of a program
+ * image so that the paths the profile shows hot fall through:
+ *
+ *   iss prog.bin                                  (writes profile.txt)
+ *   sp_layout prog.bin profile.txt prog_opt.bin   (and prog_opt.map if
+ *                                                  prog.map exists)
+ *
+ * Blocks are chained greedily along their heaviest edges. A conditional
+ * branch whose taken side ends up behind it is inverted (JEQ/JNE swap,
+ * JLT a,b becomes JLE b,a and back), a jump to the next block is dropped,
+ * and a JEQ r0, r0, r0 is added where a block lost its fall-through
+ * successor. A LOOP and its body move as one block. Branch and LOOP
+ * targets are relocated, data stays where it is: the new code has to fit
+ * into the old code and the unused zero words after it.
+ *
+ * The code is what is reachable from address 0, dead code in between moves
+ * along. Programs whose control flow depends on code addresses are
+ * refused: JIN, reading r7 (the taken branches leave their PC there) and
+ * branches comparing their immediate.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define MAX_BLOCKS     4096
+
+#define JLT         16
+#define JLE         17
+#define JEQ         18
+#define JNE         19
+#define JIN         20
+#define CAS         21
+#define HLT         24
+#define LOOP        27
+
+#define OP(inst)    ((int)((inst) >> 25) & 0x1F)
+#define DST(inst)   ((int)((inst) >> 22) & 0x07)
+#define SRC0(inst)  ((int)((inst) >> 19) & 0x07)
+#define SRC1(inst)  ((int)((inst) >> 16) & 0x07)
+#define IMM(inst)   ((int)(inst) & 0xFFFF)
+
+#define IS_BRANCH(op)   ((op) >= JLT && (op) <= JNE)
+#define JUMP_TO(addr)   (((unsigned int)JEQ << 25) | ((addr) & 0xFFFF))
+
+// how a block ends
+enum { T_FALL, T_COND, T_JUMP, T_STOP };
+
+typedef struct {
+    int first, last;        // original addresses
+    int kind;
+    int target, fall;       // successor blocks, -1 for none
+    long long weight;       // executions of the block
+    int next, prev;         // layout chain
+    int at;                 // new address
+    int drop, add, invert;  // terminator rewrite
+} block_t;
+
+typedef struct {
+    int from, to, fall;
+    long long weight;
+} edge_t;
+
+static unsigned int mem[MEM_SIZE], out[MEM_SIZE];
+static int image_len;
+static long long exec_count[MEM_SIZE], taken_count[MEM_SIZE];
+static unsigned char accessed[MEM_SIZE], is_code[MEM_SIZE], leader[MEM_SIZE + 1];
+static int block_of[MEM_SIZE];
+static int code_end;
+
+static block_t blocks[MAX_BLOCKS];
+static int nr_blocks;
+static edge_t edges[2 * MAX_BLOCKS];
+static int nr_edges;
+
+static void error(const char *msg, int addr)
+{
+    fprintf(stderr, "sp_layout: error: %s at %d\n", msg, addr);
+    exit(1);
+}
+
+static void read_image(const char *name)
+{
+    char line[64];
+    FILE *fp = fopen(name, "r");
+
+    if (!fp) {
+        printf("couldn't open file %s\n", name);
+        exit(1);
+    }
+    while (image_len < MEM_SIZE && fgets(line, sizeof(line), fp))
+        sscanf(line, "%x", &mem[image_len++]);
+    fclose(fp);
+}
+
+static void read_profile(const char *name)
+{
+    long long executed, taken;
+    int addr, data;
+    FILE *fp = fopen(name, "r");
+
+    if (!fp) {
+        printf("couldn't open file %s\n", name);
+        exit(1);
+    }
+    while (fscanf(fp, "%d %lld %lld %d", &addr, &executed, &taken, &data) == 4) {
+        if (addr < 0 || addr >= MEM_SIZE)
+            continue;
+        exec_count[addr] = executed;
+        taken_count[addr] = taken;
+        accessed[addr] = data;
+    }
+    fclose(fp);
+}
+
+// mark the code reachable from 0 and refuse what can't be relocated
+static void find_code(void)
+{
+    static int stack[MEM_SIZE];
+    int sp = 0, pc, i;
+
+    stack[sp++] = 0;
+    while (sp) {
+        pc = stack[--sp];
+        while (pc < MEM_SIZE && !is_code[pc]) {
+            unsigned int inst = mem[pc];
+            int op = OP(inst);
+
+            is_code[pc] = 1;
+            if (op == JIN)
+                error("JIN jumps to a computed address", pc);
+            if (SRC0(inst) == 7 || SRC1(inst) == 7 || (op == CAS && DST(inst) == 7))
+                error("r7 holds a code address after a taken branch, it is read", pc);
+            if (IS_BRANCH(op) && (SRC0(inst) == 1 || SRC1(inst) == 1))
+                error("the branch compares its target", pc);
+            if (IS_BRANCH(op) || op == LOOP)
+                stack[sp++] = IMM(inst);
+            if (op == HLT || (IS_BRANCH(op) && SRC0(inst) == SRC1(inst) && (op == JEQ || op == JLE)))
+                break;
+            pc++;
+        }
+    }
+
+    for (i = 0; i < MEM_SIZE; i++)
+        if (is_code[i])
+            code_end = i + 1;
+    // what sits in between is dead code, it moves along
+    for (i = 0; i < code_end; i++) {
+        if (!is_code[i] && accessed[i])
+            error("the program reads or writes data inside its code", i);
+        is_code[i] = 1;
+    }
+}
+
+static int successor_block(int addr)
+{
+    return addr < code_end ? block_of[addr] : -1;
+}
+
+static void find_blocks(void)
+{
+    int pc, i, first, last, end;
+
+    leader[0] = 1;
+    for (pc = 0; pc < code_end; pc++) {
+        int op = OP(mem[pc]);
+
+        if (IS_BRANCH(op)) {
+            if (IMM(mem[pc]) < code_end)
+                leader[IMM(mem[pc])] = 1;
+            leader[pc + 1] = 1;
+        }
+        else if (op == HLT) {
+            leader[pc + 1] = 1;
+        }
+        else if (op == LOOP) {
+            if (IMM(mem[pc]) <= pc || IMM(mem[pc]) >= code_end)
+                error("the LOOP body is outside the code", pc);
+            leader[pc] = 1;
+            leader[IMM(mem[pc]) + 1] = 1;
+        }
+    }
+
+    // a LOOP block runs to the end of the body, whatever starts inside it
+    for (first = 0; first < code_end; first = last + 1) {
+        block_t *b = &blocks[nr_blocks];
+        int op;
+
+        if (nr_blocks == MAX_BLOCKS)
+            error("too many blocks", first);
+        last = end = first;
+        for (;;) {
+            op = OP(mem[last]);
+            if (op == LOOP && IMM(mem[last]) > end)
+                end = IMM(mem[last]);
+            if (last < end || (!IS_BRANCH(op) && op != HLT && !leader[last + 1] && last + 1 < code_end))
+                last++;
+            else
+                break;
+        }
+        b->first = first;
+        b->last = last;
+        b->weight = exec_count[first];
+        b->next = b->prev = -1;
+        for (i = first; i <= last; i++)
+            block_of[i] = nr_blocks;
+        nr_blocks++;
+    }
+
+    for (i = 0; i < nr_blocks; i++) {
+        block_t *b = &blocks[i];
+        unsigned int inst = mem[b->last];
+        int op = OP(inst);
+
+        b->fall = successor_block(b->last + 1);
+        b->target = -1;
+        if (op == HLT) {
+            b->kind = T_STOP;
+        }
+        else if (IS_BRANCH(op) && OP(mem[b->first]) != LOOP) {
+            // a branch into a LOOP body isn't an edge the layout can use
+            if (IMM(inst) < code_end && blocks[block_of[IMM(inst)]].first == IMM(inst))
+                b->target = block_of[IMM(inst)];
+            b->kind = (SRC0(inst) == SRC1(inst) && (op == JEQ || op == JLE)) ? T_JUMP : T_COND;
+        }
+        else {
+            b->kind = T_FALL;
+        }
+    }
+}
+
+static void add_edge(int from, int to, long long weight, int fall)
+{
+    if (to < 0)
+        return;
+    edges[nr_edges].from = from;
+    edges[nr_edges].to = to;
+    edges[nr_edges].weight = weight;
+    edges[nr_edges].fall = fall;
+    nr_edges++;
+}
+
+// heaviest first, then fall-through edges, then the original order
+static int compare_edges(const void *a, const void *b)
+{
+    const edge_t *x = a, *y = b;
+
+    if (x->weight != y->weight)
+        return x->weight < y->weight ? 1 : -1;
+    if (x->fall != y->fall)
+        return y->fall - x->fall;
+    return x->from - y->from;
+}
+
+static int chain_head(int b)
+{
+    while (blocks[b].prev >= 0)
+        b = blocks[b].prev;
+    return b;
+}
+
+static void chain_blocks(void)
+{
+    int i;
+
+    for (i = 0; i < nr_blocks; i++) {
+        block_t *b = &blocks[i];
+        long long at_end = exec_count[b->last];
+
+        switch (b->kind) {
+        case T_COND:
+            add_edge(i, b->target, taken_count[b->last], 0);
+            add_edge(i, b->fall, at_end - taken_count[b->last], 1);
+            break;
+        case T_JUMP:
+            add_edge(i, b->target, at_end, 0);
+            break;
+        case T_FALL:
+            add_edge(i, b->fall, b->weight, 1);
+            break;
+        }
+    }
+    qsort(edges, nr_edges, sizeof(edges[0]), compare_edges);
+
+    // the entry block stays first
+    for (i = 0; i < nr_edges; i++) {
+        block_t *from = &blocks[edges[i].from], *to = &blocks[edges[i].to];
+
+        if (edges[i].to == 0 || from->next >= 0 || to->prev >= 0 ||
+            chain_head(edges[i].from) == edges[i].to)
+            continue;
+        from->next = edges[i].to;
+        to->prev = edges[i].from;
+    }
+}
+
+// decide the terminators and the new addresses, chains in original order
+static int place_blocks(int *order)
+{
+    int i, n = 0, at = 0;
+
+    for (i = 0; i < nr_blocks; i++) {
+        int b;
+
+        if (blocks[i].prev >= 0)
+            continue;
+        for (b = i; b >= 0; b = blocks[b].next)
+            order[n++] = b;
+    }
+
+    for (i = 0; i < n; i++) {
+        block_t *b = &blocks[order[i]];
+        int next = (i + 1 < n) ? order[i + 1] : -1;
+
+        b->drop = b->add = b->invert = 0;
+        switch (b->kind) {
+        case T_COND:
+            if (next == b->target && next >= 0 && b->target != b->fall)
+                b->invert = 1;
+            else if (next != b->fall)
+                b->add = 1;
+            break;
+        case T_JUMP:
+            b->drop = (next == b->target && next >= 0);
+            break;
+        case T_FALL:
+            b->add = (next != b->fall);
+            break;
+        }
+        b->at = at;
+        at += b->last - b->first + 1 - b->drop + b->add;
+    }
+    return at;
+}
+
+static int new_address(int addr)
+{
+    if (addr >= code_end)
+        return addr;
+    return blocks[block_of[addr]].at + addr - blocks[block_of[addr]].first;
+}
+
+static int block_address(int b, int old)
+{
+    return b >= 0 ? blocks[b].at : old;
+}
+
+static unsigned int relocate(unsigned int inst)
+{
+    int op = OP(inst);
+
+    if (IS_BRANCH(op) || op == LOOP)
+        return (inst & ~0xFFFF) | (new_address(IMM(inst)) & 0xFFFF);
+    return inst;
+}
+
+static void emit_blocks(int *order, int n)
+{
+    int i, addr;
+
+    for (i = 0; i < n; i++) {
+        block_t *b = &blocks[order[i]];
+        int at = b->at;
+
+        for (addr = b->first; addr <= b->last - b->drop; addr++)
+            out[at++] = relocate(mem[addr]);
+        if (b->invert) {
+            unsigned int inst = mem[b->last];
+            int op = OP(inst), s0 = SRC0(inst), s1 = SRC1(inst);
+
+            switch (op) {
+            case JEQ: op = JNE; break;
+            case JNE: op = JEQ; break;
+            case JLT: op = JLE; s0 = SRC1(inst); s1 = SRC0(inst); break;
+            case JLE: op = JLT; s0 = SRC1(inst); s1 = SRC0(inst); break;
+            }
+            out[at - 1] = ((unsigned int)op << 25) | (DST(inst) << 22) | (s0 << 19) | (s1 << 16) |
+                          (block_address(b->fall, b->last + 1) & 0xFFFF);
+        }
+        if (b->add)
+            out[at++] = JUMP_TO(block_address(b->fall, b->last + 1));
+    }
+}
+
+// taken branches of a layout, estimated from the profile
+static long long count_taken(int after)
+{
+    long long n = 0;
+    int i;
+
+    for (i = 0; i < nr_blocks; i++) {
+        block_t *b = &blocks[i];
+        long long at_end = exec_count[b->last], taken = taken_count[b->last];
+
+        switch (b->kind) {
+        case T_COND:
+            if (!after)
+                n += taken;
+            else if (b->invert)
+                n += at_end - taken;
+            else
+                n += taken + (b->add ? at_end - taken : 0);
+            break;
+        case T_JUMP:
+            n += (after && b->drop) ? 0 : at_end;
+            break;
+        case T_FALL:
+            n += (after && b->add) ? b->weight : 0;
+            break;
+        }
+    }
+    return n;
+}
+
+// name.bin -> name.map
+static void map_name(char *buf, int size, const char *name)
+{
+    char *dot;
+
+    snprintf(buf, size - 4, "%s", name);
+    dot = strrchr(buf, '.');
+    if (dot && !strchr(dot, '/'))
+        *dot = 0;
+    strcat(buf, ".map");
+}
+
+static void relocate_map(const char *inname, const char *outname)
+{
+    char in_map[1024], out_map[1024], name[256];
+    int addr;
+    FILE *in, *fp;
+
+    map_name(in_map, sizeof(in_map), inname);
+    map_name(out_map, sizeof(out_map), outname);
+    in = fopen(in_map, "r");
+    if (!in)
+        return;
+    fp = fopen(out_map, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", out_map);
+        exit(1);
+    }
+    while (fscanf(in, "%d %255s", &addr, name) == 2)
+        fprintf(fp, "%d %s\n", (addr >= 0 && addr < MEM_SIZE) ? new_address(addr) : addr, name);
+    fclose(in);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    static int order[MAX_BLOCKS];
+    int i, end, len;
+    FILE *fp;
+
+    if (argc != 4) {
+        fprintf(stderr, "usage: sp_layout <program.bin> <profile.txt> <output.bin>\n");
+        return 1;
+    }
+    read_image(argv[1]);
+    read_profile(argv[2]);
+    find_code();
+    find_blocks();
+    chain_blocks();
+    end = place_blocks(order);
+
+    for (i = code_end; i < end; i++)
+        if (i >= MEM_SIZE || mem[i] || accessed[i])
+            error("no room for the new code", i);
+    memcpy(out, mem, sizeof(out));
+    for (i = 0; i < code_end; i++)
+        out[i] = 0;
+    emit_blocks(order, nr_blocks);
+
+    len = image_len > end ? image_len : end;
+    fp = fopen(argv[3], "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", argv[3]);
+        exit(1);
+    }
+    for (i = 0; i < len; i++)
+        fprintf(fp, "%08x\n", out[i]);
+    fclose(fp);
+    relocate_map(argv[1], argv[3]);
+
+    printf("sp_layout: %d blocks, code %d -> %d words, taken branches %lld -> %lld\n",
+           nr_blocks, code_end, end, count_taken(0), count_taken(1));
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * SP ASM: Integer Square Root with the multiply/divide unit
+ *
+ * Same interface as lab #1/sqrtq_asm.c: the input number is at 1000 and the
+ * result goes to 1001. Newton's iteration x = (x + N / x) / 2 replaces the
+ * shift/subtract bit loop. The result is then checked with MUL
+ * (x * x <= N < (x + 1) * (x + 1)), 1002 gets 1 (PASS) or 2 (FAIL) and 1003
+ * the remainder N % x.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ADD         0
+#define SUB         1
+#define LSF         2
+#define RSF         3
+#define AND         4
+#define OR          5
+#define XOR         6
+#define LHI         7
+#define LD          8
+#define ST          9
+#define JLT         16
+#define JLE         17
+#define JEQ         18
+#define JNE         19
+#define JIN         20
+#define MUL         22
+#define DIV         23
+#define HLT         24
+#define MOD         25
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define INPUT       1000
+#define OUTPUT      1001
+#define RESULT      1002
+#define REMAINDER   1003
+
+unsigned int mem[MEM_SIZE];
+int pc = 0;
+
+static void asm_cmd(int opcode, int dst, int src0, int src1, int imm)
+{
+    int inst = ((opcode & 0x1F) << 25)
+             | ((dst     & 0x07) << 22)
+             | ((src0    & 0x07) << 19)
+             | ((src1    & 0x07) << 16)
+             | (imm       & 0xFFFF);
+    mem[pc++] = inst;
+}
+
+// point the branch at "at" to "target"
+static void patch(int at, int target)
+{
+    mem[at] = (mem[at] & ~0xFFFF) | (target & 0xFFFF);
+}
+
+static void assemble_program(const char *outname, int n)
+{
+    int i, zero, loop, done, fail0, fail1, halt;
+
+    for (i = 0; i < MEM_SIZE; i++) mem[i] = 0;
+
+    // r2 = N, r3 = x
+    asm_cmd(LD,  2, 0, 1, INPUT);
+    asm_cmd(ADD, 3, 2, 0, 0);
+    zero = pc;
+    asm_cmd(JEQ, 0, 2, 0, 0);
+
+    // r4 = (x + N / x) / 2, done once it stops decreasing
+    loop = pc;
+    asm_cmd(DIV, 4, 2, 3, 0);
+    asm_cmd(ADD, 4, 4, 3, 0);
+    asm_cmd(RSF, 4, 4, 1, 1);
+    done = pc;
+    asm_cmd(JLE, 0, 3, 4, 0);
+    asm_cmd(ADD, 3, 4, 0, 0);
+    asm_cmd(JEQ, 0, 0, 0, loop);
+
+    // check x * x <= N < (x + 1) * (x + 1), r5 = remainder
+    patch(done, pc);
+    asm_cmd(MUL, 4, 3, 3, 0);
+    fail0 = pc;
+    asm_cmd(JLT, 0, 2, 4, 0);
+    asm_cmd(ADD, 6, 3, 1, 1);
+    asm_cmd(MUL, 4, 6, 6, 0);
+    fail1 = pc;
+    asm_cmd(JLE, 0, 4, 2, 0);
+    asm_cmd(MOD, 5, 2, 3, 0);
+    asm_cmd(ADD, 6, 1, 0, REMAINDER);
+    asm_cmd(ST,  0, 5, 6, 0);
+
+    // PASS
+    patch(zero, pc);
+    asm_cmd(ST,  0, 3, 1, OUTPUT);
+    asm_cmd(ADD, 5, 1, 0, 1);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    halt = pc;
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    // FAIL
+    patch(fail0, pc);
+    patch(fail1, pc);
+    asm_cmd(ST,  0, 3, 1, OUTPUT);
+    asm_cmd(ADD, 5, 1, 0, 2);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(JEQ, 0, 0, 0, halt);
+
+    mem[INPUT] = n;
+
+    FILE *fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i <= REMAINDER; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: asm <output_sram.txt> [N]\n");
+        return 1;
+    }
+    assemble_program(argv[1], argc == 3 ? atoi(argv[2]) : 3000);
+    printf("SP assembler generated %s (multiply/divide sqrt test)\n", argv[1]);
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * SP ASM: WFE Multithreading Test
+ *
+ * Context 0 of the lab3_A pipelined core sleeps in WFE until a DMA copy of
+ * 64 words from SRC to DST completes, then sums DST and writes 1 (PASS) or
+ * 2 (FAIL) to RESULT. With more than one hardware thread (SP_NR_THREADS)
+ * context 1 starts the copy while context 0 is already asleep, then waits in
+ * WFE for the same completion and writes 1 to DONE1. On one thread context 0
+ * starts the copy itself. Other contexts halt at once.
+ *
+ * A sleeping thread has to leave the pipeline to its siblings, or the DMA
+ * never starts. Both contexts have to see the completion event, also on
+ * cores the parallel kernel runs on other host threads (make mt_wfe in
+ * lab3_A).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ADD         0
+#define SUB         1
+#define LD          8
+#define ST          9
+#define DMA_START   10
+#define WFE         13
+#define CPUID       14
+#define JLT         16
+#define JEQ         18
+#define JNE         19
+#define HLT         24
+
+#define MEM_SIZE_BITS  (16)
+#define MEM_SIZE       (1 << MEM_SIZE_BITS)
+
+#define LEN         64
+#define SRC         256
+#define DST         512
+#define RESULT      1000
+#define DONE1       1001
+#define EXPECTED    1002
+
+unsigned int mem[MEM_SIZE];
+int pc = 0;
+
+static void asm_cmd(int opcode, int dst, int src0, int src1, int imm)
+{
+    int inst = ((opcode & 0x1F) << 25)
+             | ((dst     & 0x07) << 22)
+             | ((src0    & 0x07) << 19)
+             | ((src1    & 0x07) << 16)
+             | (imm       & 0xFFFF);
+    mem[pc++] = inst;
+}
+
+static void assemble_program(const char *outname)
+{
+    int i, ctx0, single, wait, loop, fail, halt;
+    unsigned int sum = 0;
+
+    for (i = 0; i < MEM_SIZE; i++) mem[i] = 0;
+    for (i = 0; i < LEN; i++) {
+        mem[SRC + i] = i * 2654435761u + 1;
+        sum += mem[SRC + i];
+    }
+    mem[EXPECTED] = sum;
+
+    // r2 = context, r4 = number of contexts, r3 = SRC, r6 = DST
+    asm_cmd(CPUID, 2, 0, 0, 0);
+    asm_cmd(CPUID, 4, 0, 0, 1);
+    asm_cmd(ADD, 3, 1, 0, SRC);
+    asm_cmd(ADD, 6, 1, 0, DST);
+    ctx0 = pc;
+    asm_cmd(JEQ, 0, 2, 0, 0);
+    asm_cmd(ADD, 5, 1, 0, 1);
+    halt = pc;
+    asm_cmd(JNE, 0, 2, 5, 0);           // contexts 2 and up are done
+
+    // context 1: let context 0 fall asleep, start the copy, wait for it too
+    for (i = 0; i < 8; i++)
+        asm_cmd(ADD, 5, 5, 1, 1);
+    asm_cmd(DMA_START, 0, 3, 6, LEN);
+    asm_cmd(WFE, 0, 0, 0, 0);
+    asm_cmd(ADD, 5, 1, 0, 1);
+    asm_cmd(ST,  0, 5, 1, DONE1);
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    // context 0: start the copy when it runs alone, sleep until it is done
+    mem[ctx0] |= pc;
+    asm_cmd(ADD, 5, 1, 0, 1);
+    single = pc;
+    asm_cmd(JNE, 0, 4, 5, 0);
+    asm_cmd(DMA_START, 0, 3, 6, LEN);
+    mem[single] |= pc;
+    wait = pc;
+    asm_cmd(WFE, 0, 0, 0, 0);
+    asm_cmd(LD,  5, 0, 1, DST + LEN - 1);
+    asm_cmd(JEQ, 0, 5, 0, wait);
+
+    // r3 = sum of DST, r2 = pointer, r6 = end
+    asm_cmd(ADD, 3, 0, 0, 0);
+    asm_cmd(ADD, 2, 1, 0, DST);
+    asm_cmd(ADD, 6, 1, 0, DST + LEN);
+    loop = pc;
+    asm_cmd(LD,  5, 0, 2, 0);
+    asm_cmd(ADD, 3, 3, 5, 0);
+    asm_cmd(ADD, 2, 2, 1, 1);
+    asm_cmd(JLT, 0, 2, 6, loop);
+
+    // check the sum
+    asm_cmd(LD,  4, 0, 1, EXPECTED);
+    fail = pc;
+    asm_cmd(JNE, 0, 3, 4, 0);
+    asm_cmd(ADD, 5, 1, 0, 1);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    asm_cmd(HLT, 0, 0, 0, 0);
+    mem[fail] |= pc;
+    asm_cmd(ADD, 5, 1, 0, 2);
+    asm_cmd(ST,  0, 5, 1, RESULT);
+    mem[halt] |= pc;
+    asm_cmd(HLT, 0, 0, 0, 0);
+
+    FILE *fp = fopen(outname, "w");
+    if (!fp) {
+        printf("couldn't open file %s\n", outname);
+        exit(1);
+    }
+    for (i = 0; i <= EXPECTED; i++)
+        fprintf(fp, "%08x\n", mem[i]);
+    fclose(fp);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: asm <output_sram.txt>\n");
+        return 1;
+    }
+    assemble_program(argv[1]);
+    printf("SP assembler generated %s (WFE multithreading test)\n", argv[1]);
+    return 0;
+}
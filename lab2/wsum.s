@@ -0,0 +1,48 @@
+; SP ASM: Weighted Sum
+;
+; SUM = sum of A[i] + 2 * B[i] over 16 words, written the obvious way with
+; every loaded value used by the next instruction. RESULT gets 1 (PASS) or 2
+; (FAIL). Assembled with -s the scheduler moves the loads apart from their
+; users:
+;
+;   make wsum.bin ASMFLAGS=-s
+
+.equ N, 16
+
+.macro LI reg, value
+        ADD  \reg, r1, r0, \value
+.endm
+
+; r2 = A pointer, r3 = B pointer, r6 = sum, r4/r5 = temporaries
+        LI   r2, a
+        LI   r3, b
+        LI   r6, 0
+        LI   r4, N
+        LOOP r0, r4, r0, last
+        LD   r4, r0, r2, 0
+        ADD  r6, r6, r4, 0
+        LD   r5, r0, r3, 0
+        LSF  r5, r5, r1, 1
+        ADD  r6, r6, r5, 0
+        ADD  r2, r2, r1, 1
+last:   ADD  r3, r3, r1, 1
+
+        ST   r0, r6, r1, sum
+        LD   r4, r0, r1, expected
+        JNE  r0, r6, r4, fail
+        LI   r5, 1
+        ST   r0, r5, r1, result
+        HLT
+fail:   LI   r5, 2
+        ST   r0, r5, r1, result
+        HLT
+
+.org 1000
+sum:    .word 0
+expected:
+        .word 2215
+result: .word 0
+a:      .word 5, 42, 79, 15, 52, 89, 25, 62
+        .word 99, 35, 72, 8, 45, 82, 18, 55
+b:      .word 11, 64, 20, 73, 29, 82, 38, 91
+        .word 47, 3, 56, 12, 65, 21, 74, 30
@@ -10,7 +10,32 @@ static const char* LLSIM_BUILD_TAG = "LLSIM sizeof_fix " __DATE__ " " __TIME__;
  * chip simulator
  */
 llsim_t *llsim = NULL;
-static int stop_sim = 0;
+static volatile int stop_sim = 0;
+
+// jump the clock over stretches where every unit is quiescent
+#ifndef LLSIM_SKIP_IDLE
+#define LLSIM_SKIP_IDLE 1
+#endif
+
+// don't run event driven units that sit at a fixed point
+#ifndef LLSIM_EVENT_DRIVEN
+#define LLSIM_EVENT_DRIVEN 1
+#endif
+
+// host threads evaluating the units, 1 = serial (more need -pthread)
+#ifndef LLSIM_THREADS
+#define LLSIM_THREADS 1
+#endif
+
+// clocks between host thread syncs, 1 = cycle exact
+#ifndef LLSIM_QUANTUM
+#define LLSIM_QUANTUM 1
+#endif
+
+#if LLSIM_THREADS > 1
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 void *llsim_malloc(int len)
 {
@@ -286,42 +311,503 @@ int llsim_mem_extract_dataout(llsim_memory_t *memory, int msb, int lsb)
 	return sbs(*p,msb,lsb);
 }
 
-void llsim_run_clock(void)
+/*
+ * prefetchers
+ */
+static int llsim_pf_lookup(llsim_prefetcher_t *pf, int line)
+{
+	int i;
+
+	for (i = 0; i < LLSIM_PF_BUFFER_SIZE; i++)
+		if (pf->buf_valid[i] && pf->buf_line[i] == line)
+			return i;
+	return -1;
+}
+
+static void llsim_pf_issue(llsim_prefetcher_t *pf, int line)
+{
+	int i;
+
+	if (line < 0 || llsim_pf_lookup(pf, line) >= 0)
+		return;
+	i = pf->buf_next;
+	pf->buf_valid[i] = 1;
+	pf->buf_line[i] = line;
+	pf->buf_ready[i] = llsim->clock + pf->latency;
+	pf->buf_used[i] = 0;
+	pf->buf_next = (i + 1) % LLSIM_PF_BUFFER_SIZE;
+	pf->issued++;
+}
+
+void llsim_pf_next_line_train(llsim_prefetcher_t *pf, int pc, int addr)
+{
+	int line, i;
+
+	line = addr / pf->line_words;
+	for (i = 0; i < pf->degree; i++)
+		llsim_pf_issue(pf, line + pf->distance + i);
+}
+
+void llsim_pf_stride_train(llsim_prefetcher_t *pf, int pc, int addr)
+{
+	int e, i, stride;
+
+	e = pc % LLSIM_PF_TABLE_SIZE;
+	if (!pf->st_valid[e] || pf->st_pc[e] != pc) {
+		pf->st_valid[e] = 1;
+		pf->st_pc[e] = pc;
+		pf->st_addr[e] = addr;
+		pf->st_stride[e] = 0;
+		pf->st_conf[e] = 0;
+		return;
+	}
+
+	stride = addr - pf->st_addr[e];
+	if (stride != 0 && stride == pf->st_stride[e]) {
+		if (pf->st_conf[e] < 3)
+			pf->st_conf[e]++;
+	} else {
+		pf->st_stride[e] = stride;
+		pf->st_conf[e] = 0;
+	}
+	pf->st_addr[e] = addr;
+
+	if (pf->st_conf[e] < 2)
+		return;
+	for (i = 0; i < pf->degree; i++)
+		llsim_pf_issue(pf, (addr + stride * (pf->distance + i)) / pf->line_words);
+}
+
+llsim_prefetcher_t *llsim_allocate_prefetcher(llsim_memory_t *memory, char *name,
+	void (*train) (llsim_prefetcher_t *pf, int pc, int addr),
+	int line_words, int degree, int distance, int latency)
+{
+	llsim_prefetcher_t *pf;
+
+	llsim_assert(line_words > 0 && degree > 0 && distance > 0, "ERROR: bad prefetcher configuration for memory %s", memory->name);
+
+	pf = (llsim_prefetcher_t *) llsim_malloc(sizeof(llsim_prefetcher_t));
+	pf->name = (char *) llsim_malloc(strlen(name)+1);
+	strcpy(pf->name, name);
+	pf->train = train;
+	pf->line_words = line_words;
+	pf->degree = degree;
+	pf->distance = distance;
+	pf->latency = latency;
+	pf->last_line = -1;
+	memory->pf = pf;
+	return pf;
+}
+
+/*
+ * called by the owning unit on every demand access to the memory
+ */
+void llsim_prefetch_access(llsim_memory_t *memory, int pc, int addr)
+{
+	llsim_prefetcher_t *pf = memory->pf;
+	int line, i;
+
+	if (!pf)
+		return;
+
+	llsim_lock();
+	line = addr / pf->line_words;
+	if (line != pf->last_line) {
+		pf->demand_lines++;
+		i = llsim_pf_lookup(pf, line);
+		if (i >= 0) {
+			if (!pf->buf_used[i])
+				pf->useful++;
+			pf->buf_used[i] = 1;
+			if (pf->buf_ready[i] <= llsim->clock)
+				pf->timely++;
+			else
+				pf->late++;
+		}
+		pf->last_line = line;
+	}
+	pf->train(pf, pc, addr);
+	llsim_unlock();
+}
+
+void llsim_prefetch_dump(FILE *fp, llsim_memory_t *memory)
+{
+	llsim_prefetcher_t *pf = memory->pf;
+	i64 covered;
+
+	if (!pf)
+		return;
+
+	covered = pf->timely + pf->late;
+	fprintf(fp, "prefetch %s %s: line_words %d degree %d distance %d latency %d\n",
+		memory->name, pf->name, pf->line_words, pf->degree, pf->distance, pf->latency);
+	fprintf(fp, "prefetch %s issued %lld useful %lld demand_lines %lld timely %lld late %lld\n",
+		memory->name, pf->issued, pf->useful, pf->demand_lines, pf->timely, pf->late);
+	fprintf(fp, "prefetch %s accuracy %.2f%% coverage %.2f%% timeliness %.2f%%\n",
+		memory->name,
+		pf->issued ? 100.0 * pf->useful / pf->issued : 0.0,
+		pf->demand_lines ? 100.0 * covered / pf->demand_lines : 0.0,
+		covered ? 100.0 * pf->timely / covered : 0.0);
+}
+
+/*
+ * coherent caches
+ */
+static char llsim_mesi_name[4] = { 'I', 'S', 'E', 'M' };
+
+llsim_cache_t *llsim_allocate_cache(llsim_memory_t *memory, char *name, int lines, int line_words)
+{
+	llsim_coherence_t *coh = memory->coh;
+	llsim_cache_t *cache;
+	int i;
+
+	if (!coh) {
+		coh = (llsim_coherence_t *) llsim_malloc(sizeof(llsim_coherence_t));
+		coh->memory = memory;
+		coh->line_words = line_words;
+		memory->coh = coh;
+	}
+	llsim_assert(lines > 0 && line_words == coh->line_words, "ERROR: bad cache configuration for memory %s", memory->name);
+	llsim_assert(coh->nr_caches < LLSIM_COH_MAX_CACHES, "ERROR: too many caches on memory %s", memory->name);
+
+	cache = (llsim_cache_t *) llsim_malloc(sizeof(llsim_cache_t));
+	cache->name = (char *) llsim_malloc(strlen(name)+1);
+	strcpy(cache->name, name);
+	cache->coh = coh;
+	cache->lines = lines;
+	cache->tag = (int *) llsim_malloc(lines * sizeof(int));
+	cache->state = (int *) llsim_malloc(lines * sizeof(int));
+	cache->inval_addr = (int *) llsim_malloc(lines * sizeof(int));
+	for (i = 0; i < lines; i++)
+		cache->inval_addr[i] = -1;
+	coh->caches[coh->nr_caches++] = cache;
+	return cache;
+}
+
+static int llsim_cache_state(llsim_cache_t *cache, int line)
+{
+	int i = line % cache->lines;
+
+	return (cache->tag[i] == line) ? cache->state[i] : LLSIM_MESI_I;
+}
+
+/*
+ * 1 if the access can complete without a bus transaction
+ */
+int llsim_cache_hit(llsim_cache_t *cache, int addr, int write)
+{
+	int state;
+
+	llsim_lock();
+	state = llsim_cache_state(cache, addr / cache->coh->line_words);
+	llsim_unlock();
+	return write ? (state >= LLSIM_MESI_E) : (state != LLSIM_MESI_I);
+}
+
+static void llsim_coh_hotspot(llsim_coherence_t *coh, int line)
+{
+	int i, e;
+
+	for (i = 0; i < LLSIM_COH_HOTSPOTS; i++) {
+		e = (line + i) % LLSIM_COH_HOTSPOTS;
+		if (coh->hot_count[e] == 0)
+			coh->hot_line[e] = line;
+		if (coh->hot_line[e] == line) {
+			coh->hot_count[e]++;
+			return;
+		}
+	}
+}
+
+/*
+ * snoop a bus transaction of cache "from" in every other cache
+ */
+static int llsim_coh_snoop(llsim_cache_t *from, int line, int addr, int write)
+{
+	llsim_coherence_t *coh = from->coh;
+	llsim_cache_t *cache;
+	int shared = 0, n, i;
+
+	for (n = 0; n < coh->nr_caches; n++) {
+		cache = coh->caches[n];
+		i = line % cache->lines;
+		if (cache == from || cache->tag[i] != line || cache->state[i] == LLSIM_MESI_I)
+			continue;
+		if (cache->state[i] == LLSIM_MESI_M)
+			cache->writebacks++;
+		if (write) {
+			cache->state[i] = LLSIM_MESI_I;
+			cache->inval_addr[i] = addr;
+			cache->invalidations++;
+		}
+		else {
+			cache->state[i] = LLSIM_MESI_S;
+			shared = 1;
+		}
+	}
+	return shared;
+}
+
+static int llsim_cache_do_access(llsim_cache_t *cache, int addr, int write)
+{
+	llsim_coherence_t *coh = cache->coh;
+	int line = addr / coh->line_words;
+	int i = line % cache->lines;
+	int state = llsim_cache_state(cache, line);
+	int kind, shared;
+
+	if (write)
+		cache->writes++;
+	else
+		cache->reads++;
+
+	if (write ? (state >= LLSIM_MESI_E) : (state != LLSIM_MESI_I)) {
+		cache->hits++;
+		if (write)
+			cache->state[i] = LLSIM_MESI_M;
+		return LLSIM_CACHE_HIT;
+	}
+
+	if (state == LLSIM_MESI_S) {
+		// write to a shared line: invalidate the other copies
+		cache->upgrades++;
+		coh->bus_upgr++;
+		llsim_coh_snoop(cache, line, addr, 1);
+		cache->state[i] = LLSIM_MESI_M;
+		return LLSIM_CACHE_UPGRADE;
+	}
+
+	kind = LLSIM_CACHE_MISS;
+	if (cache->tag[i] == line && cache->inval_addr[i] >= 0) {
+		kind = LLSIM_CACHE_COHERENCE_MISS;
+		cache->coherence_misses++;
+		if (cache->inval_addr[i] != addr) {
+			cache->false_sharing++;
+			llsim_coh_hotspot(coh, line);
+		}
+	}
+	else {
+		cache->misses++;
+		if (cache->tag[i] != line && cache->state[i] == LLSIM_MESI_M)
+			cache->writebacks++;
+	}
+
+	if (write)
+		coh->bus_rdx++;
+	else
+		coh->bus_rd++;
+	shared = llsim_coh_snoop(cache, line, addr, write);
+	cache->tag[i] = line;
+	cache->inval_addr[i] = -1;
+	cache->state[i] = write ? LLSIM_MESI_M : (shared ? LLSIM_MESI_S : LLSIM_MESI_E);
+	llsim_printf("llsim: clock %d: %s %s addr %d line %d --> %c\n", llsim->clock, cache->name,
+		write ? "BusRdX" : "BusRd", addr, line, llsim_mesi_name[cache->state[i]]);
+	return kind;
+}
+
+/*
+ * perform an access, returns LLSIM_CACHE_HIT or the kind of miss
+ */
+int llsim_cache_access(llsim_cache_t *cache, int addr, int write)
+{
+	int kind;
+
+	llsim_lock();
+	kind = llsim_cache_do_access(cache, addr, write);
+	llsim_unlock();
+	return kind;
+}
+
+/*
+ * a unit without a cache (DMA) wrote the backing memory
+ */
+void llsim_coherence_write(llsim_memory_t *memory, int addr)
+{
+	llsim_coherence_t *coh = memory->coh;
+	llsim_cache_t *cache;
+	int line, n, i;
+
+	if (!coh)
+		return;
+
+	llsim_lock();
+	coh->external_writes++;
+	line = addr / coh->line_words;
+	for (n = 0; n < coh->nr_caches; n++) {
+		cache = coh->caches[n];
+		i = line % cache->lines;
+		if (cache->tag[i] == line && cache->state[i] != LLSIM_MESI_I) {
+			cache->state[i] = LLSIM_MESI_I;
+			cache->inval_addr[i] = -1;
+			cache->invalidations++;
+		}
+	}
+	llsim_unlock();
+}
+
+void llsim_coherence_dump(FILE *fp, llsim_memory_t *memory)
+{
+	llsim_coherence_t *coh = memory->coh;
+	llsim_cache_t *cache;
+	int n, i, top;
+
+	if (!coh)
+		return;
+
+	fprintf(fp, "coherence %s: line_words %d caches %d bus_rd %lld bus_rdx %lld bus_upgr %lld external_writes %lld\n",
+		memory->name, coh->line_words, coh->nr_caches, coh->bus_rd, coh->bus_rdx, coh->bus_upgr, coh->external_writes);
+	for (n = 0; n < coh->nr_caches; n++) {
+		cache = coh->caches[n];
+		fprintf(fp, "cache %s: lines %d reads %lld writes %lld hits %lld hit_rate %.2f%%\n",
+			cache->name, cache->lines, cache->reads, cache->writes, cache->hits,
+			(cache->reads + cache->writes) ? 100.0 * cache->hits / (cache->reads + cache->writes) : 0.0);
+		fprintf(fp, "cache %s: misses %lld coherence_misses %lld false_sharing %lld upgrades %lld invalidations %lld writebacks %lld\n",
+			cache->name, cache->misses, cache->coherence_misses, cache->false_sharing,
+			cache->upgrades, cache->invalidations, cache->writebacks);
+	}
+
+	// hottest false sharing lines first
+	for (n = 0; n < 8; n++) {
+		top = -1;
+		for (i = 0; i < LLSIM_COH_HOTSPOTS; i++)
+			if (coh->hot_count[i] > 0 && (top < 0 || coh->hot_count[i] > coh->hot_count[top]))
+				top = i;
+		if (top < 0)
+			break;
+		fprintf(fp, "false_sharing %s addr %d-%d misses %lld\n", memory->name,
+			coh->hot_line[top] * coh->line_words, (coh->hot_line[top] + 1) * coh->line_words - 1,
+			coh->hot_count[top]);
+		coh->hot_count[top] = -coh->hot_count[top];
+	}
+	for (i = 0; i < LLSIM_COH_HOTSPOTS; i++)
+		if (coh->hot_count[i] < 0)
+			coh->hot_count[i] = -coh->hot_count[i];
+}
+
+// perform the accesses the units requested on the memories of a unit
+static void llsim_run_memories(llsim_unit_t *unit)
 {
-	llsim_unit_t *unit;
-	llsim_unit_registers_t *ur;
 	llsim_memory_t *mem;
 	int read_done, write_done;
+
+	mem = unit->mems;
+	while (mem) {
+		read_done = mem->read;
+		write_done = mem->write;
+		if (mem->read) {
+			llsim_assert(mem->read_addr < mem->height, "mem %s read address %d out of range\n", mem->name, mem->read_addr);
+			*mem->dataout = mem->data[mem->read_addr];
+			llsim_printf("llsim: clock %d: READ MEM %s addr %d --> %08x\n", llsim->clock, mem->name, mem->read_addr, *mem->dataout);
+			mem->read = 0;
+		}
+		if (mem->write) {
+			llsim_assert(mem->write_addr < mem->height, "mem %s write address %d out of range\n", mem->name, mem->write_addr);
+			mem->data[mem->write_addr] = *mem->datain;
+			llsim_printf("llsim: clock %d: WRITE %08x --> MEM %s addr %d\n", llsim->clock, *mem->datain, mem->name, mem->write_addr);
+			mem->write = 0;
+		}
+		llsim_assert(!(read_done && write_done), "ERROR: simultaneous access to memory %s", mem->name);
+		if (!read_done && !write_done)
+			*mem->dataout = 0xBAADBAAD;
+		mem = mem->next;
+	}
+}
+
+static void llsim_copy_registers(llsim_unit_t *unit)
+{
+	llsim_unit_registers_t *ur;
+
+	ur = unit->regs;
+	while (ur) {
+		if (unit->event_driven && unit->settled && memcmp(ur->old, ur->new, ur->size))
+			unit->settled = 0;
+		memcpy(ur->old, ur->new, ur->size);
+		ur = ur->next;
+	}
+}
+
+/*
+ * event driven evaluation
+ *
+ * settled is 0 when the last run changed the registers of the unit, 1 when
+ * it didn't, and 2 once quiescent() also confirmed the unit waits for an
+ * event. A settled unit is skipped until one of its inputs changes.
+ */
+static int llsim_inputs_changed(llsim_unit_t *unit)
+{
+	llsim_input_t *input;
+
+	for (input = unit->inputs; input; input = input->next)
+		if ((*(int *) input->oldp & bitmask0(input->bits)) != input->value)
+			return 1;
+	return 0;
+}
+
+static void llsim_latch_inputs(llsim_unit_t *unit)
+{
+	llsim_input_t *input;
+
+	for (input = unit->inputs; input; input = input->next)
+		input->value = *(int *) input->oldp & bitmask0(input->bits);
+}
+
+static int llsim_unit_settled(llsim_unit_t *unit)
+{
+	if (!LLSIM_EVENT_DRIVEN || !unit->event_driven || llsim->reset || !unit->settled)
+		return 0;
+	if (llsim_inputs_changed(unit))
+		return 0;
+	if (unit->settled == 1) {
+		if (unit->quiescent && unit->quiescent(unit) != LLSIM_FOREVER)
+			return 0;
+		unit->settled = 2;
+	}
+	return 1;
+}
+
+static void llsim_eval_unit(llsim_unit_t *unit)
+{
+	if (llsim_unit_settled(unit)) {
+		unit->skipped_runs++;
+		return;
+	}
+	llsim_latch_inputs(unit);
+	unit->settled = 1;	// until the registers say otherwise
+	unit->run(unit);
+	unit->runs++;
+}
+
+// connect every declared input to the unit declaring the matching output
+static void llsim_build_sensitivity(void)
+{
+	llsim_unit_t *unit, *src;
+	llsim_input_t *input;
+	llsim_output_t *output;
+
+	for (unit = llsim->units; unit; unit = unit->next)
+		for (input = unit->inputs; input; input = input->next) {
+			for (src = llsim->units; src && !input->source; src = src->next)
+				for (output = src->outputs; output; output = output->next)
+					if (output->oldp == input->oldp) {
+						input->source = src;
+						break;
+					}
+			llsim_printf("llsim: %s input %s <- %s\n", unit->name, input->input_name,
+				input->source ? input->source->name : "(undeclared)");
+		}
+}
+
+void llsim_run_clock(void)
+{
+	llsim_unit_t *unit;
 	
 	/*
 	 * run units
 	 */
 	unit = llsim->units;
 	while (unit) {
-		unit->run(unit);
-
-		// memories
-		mem = unit->mems;
-		while (mem) {
-			read_done = mem->read;
-			write_done = mem->write;
-			if (mem->read) {
-				llsim_assert(mem->read_addr < mem->height, "mem %s read address %d out of range\n", mem->name, mem->read_addr);
-				*mem->dataout = mem->data[mem->read_addr];
-				llsim_printf("llsim: clock %d: READ MEM %s addr %d --> %08x\n", llsim->clock, mem->name, mem->read_addr, *mem->dataout);
-				mem->read = 0;
-			}
-			if (mem->write) {
-				llsim_assert(mem->write_addr < mem->height, "mem %s write address %d out of range\n", mem->name, mem->write_addr);
-				mem->data[mem->write_addr] = *mem->datain;
-				llsim_printf("llsim: clock %d: WRITE %08x --> MEM %s addr %d\n", llsim->clock, *mem->datain, mem->name, mem->write_addr);
-				mem->write = 0;
-			}
-			llsim_assert(!(read_done && write_done), "ERROR: simultaneous access to memory %s", mem->name);
-			if (!read_done && !write_done)
-				*mem->dataout = 0xBAADBAAD;
-			mem = mem->next;
-		}
+		llsim_eval_unit(unit);
+		llsim_run_memories(unit);
 		unit = unit->next;
 	}
 
@@ -330,13 +816,180 @@ void llsim_run_clock(void)
 	 */
 	unit = llsim->units;
 	while (unit) {
-		ur = unit->regs;
-		while (ur) {
-			memcpy(ur->old, ur->new, ur->size);
-			ur = ur->next;
-		}
+		llsim_copy_registers(unit);
+		unit = unit->next;
+	}
+}
+
+#if LLSIM_THREADS > 1
+/*
+ * parallel evaluation
+ *
+ * Units only look at the old registers of the other units and at memory
+ * outputs latched on the previous clock, so within a clock they can run in
+ * any order. The units are split among the host threads (the main thread
+ * is thread 0); a unit with an affinity goes with its partner.
+ *
+ * Cycle exact mode (quantum 1): every clock the threads run their units and
+ * meet at a barrier, then the main thread accesses the memories and copies
+ * the registers in unit order like llsim_run_clock(). The only difference
+ * is that memories are accessed after all the units ran rather than right
+ * after their owner.
+ *
+ * Relaxed mode (quantum > 1): each thread takes its own units through a
+ * whole quantum (run, memories, registers) and the threads only meet at its
+ * end, so units on different threads see each other up to quantum - 1
+ * clocks apart. llsim->clock moves at the syncs only.
+ *
+ * State the units share outside their registers (coherent caches,
+ * statistics) is updated under llsim_lock().
+ */
+static pthread_t llsim_thread_ids[LLSIM_THREADS];
+static pthread_mutex_t llsim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int llsim_barrier_count;
+static int llsim_barrier_sense;
+static volatile int llsim_sync_clocks;	// clocks until the next sync, 0 = exit
+
+// sense reversing barrier, spins for a while and then yields the host cpu
+static void llsim_barrier_wait(int *sense)
+{
+	int spins = 0;
+
+	*sense = !*sense;
+	if (__atomic_add_fetch(&llsim_barrier_count, 1, __ATOMIC_ACQ_REL) == llsim->threads) {
+		__atomic_store_n(&llsim_barrier_count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&llsim_barrier_sense, *sense, __ATOMIC_RELEASE);
+		return;
+	}
+	while (__atomic_load_n(&llsim_barrier_sense, __ATOMIC_ACQUIRE) != *sense)
+		if (++spins > 1000)
+			sched_yield();
+}
+
+static void llsim_thread_clocks(int thread)
+{
+	llsim_unit_t *unit;
+	int clock;
+
+	for (clock = 0; clock < llsim_sync_clocks; clock++) {
+		for (unit = llsim->units; unit; unit = unit->next)
+			if (unit->thread == thread) {
+				llsim_eval_unit(unit);
+				if (llsim->quantum > 1)
+					llsim_run_memories(unit);
+			}
+		if (llsim->quantum > 1)
+			for (unit = llsim->units; unit; unit = unit->next)
+				if (unit->thread == thread)
+					llsim_copy_registers(unit);
+	}
+}
+
+static void *llsim_thread_main(void *arg)
+{
+	int thread = (int) (long) arg;
+	int sense = 0;
+
+	for (;;) {
+		llsim_barrier_wait(&sense);
+		if (!llsim_sync_clocks)
+			break;
+		llsim_thread_clocks(thread);
+		llsim_barrier_wait(&sense);
+	}
+	return NULL;
+}
+
+static int llsim_main_sense;
+
+// run the units for "clocks" clocks on all the threads, 0 stops the threads
+static void llsim_run_threads(int clocks)
+{
+	llsim_unit_t *unit;
+
+	llsim_sync_clocks = clocks;
+	llsim_barrier_wait(&llsim_main_sense);
+	if (!clocks)
+		return;
+	llsim_thread_clocks(0);
+	llsim_barrier_wait(&llsim_main_sense);
+	llsim->syncs++;
+
+	if (llsim->quantum > 1)
+		return;
+	for (unit = llsim->units; unit; unit = unit->next)
+		llsim_run_memories(unit);
+	for (unit = llsim->units; unit; unit = unit->next)
+		llsim_copy_registers(unit);
+}
+
+static void llsim_start_threads(void)
+{
+	llsim_unit_t *unit;
+	long n = 0, i;
+
+	for (unit = llsim->units; unit; unit = unit->next)
+		if (!unit->affinity)
+			unit->thread = n++ % LLSIM_THREADS;
+	for (unit = llsim->units; unit; unit = unit->next)
+		if (unit->affinity)
+			unit->thread = unit->affinity->thread;
+
+	// no use for more threads than independent units
+	llsim->threads = (n < LLSIM_THREADS) ? n : LLSIM_THREADS;
+	for (i = 1; i < llsim->threads; i++)
+		pthread_create(&llsim_thread_ids[i], NULL, llsim_thread_main, (void *) i);
+	llsim_printf("llsim: %d host threads, quantum %d\n", llsim->threads, llsim->quantum);
+}
+
+static void llsim_stop_threads(void)
+{
+	int i;
+
+	llsim_run_threads(0);
+	for (i = 1; i < llsim->threads; i++)
+		pthread_join(llsim_thread_ids[i], NULL);
+}
+#endif
+
+/*
+ * idle skipping: returns the number of clocks that can be skipped, 0 if any
+ * unit has to run on the next clock
+ */
+static int llsim_quiescent_clocks(void)
+{
+	llsim_unit_t *unit;
+	int n, q;
+
+	n = LLSIM_FOREVER;
+	unit = llsim->units;
+	while (unit) {
+		q = unit->quiescent ? unit->quiescent(unit) : 0;
+		if (q < n)
+			n = q;
+		if (n == 0)
+			return 0;
 		unit = unit->next;
 	}
+	llsim_assert(n != LLSIM_FOREVER, "ERROR: all units are waiting for an event\n");
+	return n;
+}
+
+static void llsim_skip_clocks(int clocks)
+{
+	llsim_unit_t *unit;
+
+	llsim_printf("llsim: clock %d: skipping %d quiescent clocks\n", llsim->clock, clocks);
+	unit = llsim->units;
+	while (unit) {
+		if (unit->skip)
+			unit->skip(unit, clocks);
+		unit->settled = 0;	// skip() may have moved the registers
+		unit = unit->next;
+	}
+	llsim->clock += clocks;
+	llsim->skipped_clocks += clocks;
+	llsim->skips++;
 }
 
 static void llsim_init_units(char *program_name)
@@ -350,6 +1003,8 @@ static void llsim_init_units(char *program_name)
 static void llsim_init(char *program_name)
 {
 	llsim = llsim_malloc(sizeof(llsim_t));
+	llsim->threads = 1;
+	llsim->quantum = (LLSIM_THREADS > 1) ? LLSIM_QUANTUM : 1;
 	llsim_init_units(program_name);
 }
 
@@ -377,11 +1032,27 @@ void llsim_stop(void)
 	stop_sim = 1;
 }
 
+void llsim_lock(void)
+{
+#if LLSIM_THREADS > 1
+	pthread_mutex_lock(&llsim_mutex);
+#endif
+}
+
+void llsim_unlock(void)
+{
+#if LLSIM_THREADS > 1
+	pthread_mutex_unlock(&llsim_mutex);
+#endif
+}
+
 int main(int argc, char **argv)
 {
-	int i;
+	llsim_unit_t *unit;
+	int i, n;
 
 	llsim_init(argv[1]);
+	llsim_build_sensitivity();
 
 	llsim_printf("llsim: starting simulation\n");
 	llsim->reset = 1;
@@ -394,15 +1065,40 @@ int main(int argc, char **argv)
 		llsim->clock++;
 	}
 	llsim->reset = 0;
+#if LLSIM_THREADS > 1
+	llsim_start_threads();
+#endif
 	while (!stop_sim) {
+		if (LLSIM_SKIP_IDLE) {
+			n = llsim_quiescent_clocks();
+			if (n > 1)
+				llsim_skip_clocks(n);
+		}
 		printf(">>>>> clock %d <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<\n", llsim->clock);
+#if LLSIM_THREADS > 1
+		llsim_run_threads(llsim->quantum);
+		llsim->clock += llsim->quantum;
+#else
 		llsim_run_clock();
 		llsim->clock++;
+#endif
 		/*
 		if ((llsim->clock % 1000000) == 0)
 			printf("clock %d\n", llsim->clock);
 		*/
 	}
+#if LLSIM_THREADS > 1
+	llsim_stop_threads();
+	llsim_printf("llsim: %lld thread syncs\n", llsim->syncs);
+#endif
+	for (unit = llsim->units; unit; unit = unit->next) {
+		if (!unit->event_driven)
+			continue;
+		llsim_printf("llsim: %s %lld runs, %lld skipped\n", unit->name, unit->runs, unit->skipped_runs);
+		llsim->skipped_runs += unit->skipped_runs;
+	}
+	llsim_printf("llsim: %d clocks, %lld skipped in %lld jumps\n", llsim->clock, llsim->skipped_clocks, llsim->skips);
+	llsim_printf("llsim: %lld unit evaluations skipped\n", llsim->skipped_runs);
 	return 0;
 }
 
@@ -86,7 +86,8 @@ static inline i64 lsbs(i64 val, int msb, int lsb)
 
 static inline i64 lrbs(i64 val, int data, int msb, int lsb)
 {
-	val = (val & (~lbitmask(msb,lsb))) | ((data << lsb) & bitmask(msb,lsb));
+	// data is taken unsigned, a negative one must not spill above msb
+	val = (val & (~lbitmask(msb,lsb))) | (((i64)(unsigned int)data << lsb) & lbitmask(msb,lsb));
 	return val;
 }
 
@@ -116,6 +117,108 @@ typedef struct llsim_unit_registers_s {
 	struct llsim_unit_registers_s *next;
 } llsim_unit_registers_t;
 
+/*
+ * hardware prefetcher
+ *
+ * A prefetcher is attached to a memory and trained by the owning unit on
+ * every demand access. Prefetched lines are tracked in a small FIFO buffer
+ * together with the clock at which they become usable, which is enough to
+ * measure accuracy, coverage and timeliness on top of the flat memories.
+ */
+#define LLSIM_PF_BUFFER_SIZE	32
+#define LLSIM_PF_TABLE_SIZE	16
+
+typedef struct llsim_prefetcher_s {
+	char *name;
+	int line_words;		// words per line
+	int degree;		// lines issued per trigger
+	int distance;		// lines (strides for the stride prefetcher) ahead of the demand stream
+	int latency;		// clocks until a prefetched line is usable
+	void (*train) (struct llsim_prefetcher_s *pf, int pc, int addr);
+
+	// prefetch buffer (FIFO replacement)
+	int buf_valid[LLSIM_PF_BUFFER_SIZE];
+	int buf_line[LLSIM_PF_BUFFER_SIZE];
+	int buf_ready[LLSIM_PF_BUFFER_SIZE];
+	int buf_used[LLSIM_PF_BUFFER_SIZE];
+	int buf_next;
+
+	// PC indexed stride table
+	int st_valid[LLSIM_PF_TABLE_SIZE];
+	int st_pc[LLSIM_PF_TABLE_SIZE];
+	int st_addr[LLSIM_PF_TABLE_SIZE];
+	int st_stride[LLSIM_PF_TABLE_SIZE];
+	int st_conf[LLSIM_PF_TABLE_SIZE];
+
+	int last_line;
+
+	// statistics
+	i64 demand_lines;	// demand accesses that moved to a new line
+	i64 issued;		// prefetches issued
+	i64 useful;		// prefetched lines later hit by a demand access
+	i64 timely;		// demand hits on lines that had already arrived
+	i64 late;		// demand hits on lines still in flight
+} llsim_prefetcher_t;
+
+/*
+ * coherent caches
+ *
+ * Private caches over a shared memory kept coherent with a snooping MESI
+ * protocol. Only tags and states are modeled, the data always lives in the
+ * backing memory: the model decides which accesses hit and counts the bus
+ * traffic the protocol needs. Lines remember the address whose remote write
+ * invalidated them so the next miss can be told apart as false sharing.
+ */
+#define LLSIM_MESI_I	0
+#define LLSIM_MESI_S	1
+#define LLSIM_MESI_E	2
+#define LLSIM_MESI_M	3
+
+#define LLSIM_CACHE_HIT			0
+#define LLSIM_CACHE_MISS		1	// cold or conflict miss
+#define LLSIM_CACHE_COHERENCE_MISS	2	// line was taken away by another cache
+#define LLSIM_CACHE_UPGRADE		3	// write to a shared line
+
+#define LLSIM_COH_MAX_CACHES	16
+#define LLSIM_COH_HOTSPOTS	64
+
+typedef struct llsim_cache_s {
+	char *name;
+	struct llsim_coherence_s *coh;
+	int lines;		// direct mapped
+	int *tag;		// line address
+	int *state;
+	int *inval_addr;	// word written by the cache that invalidated the line, -1 if none
+
+	// statistics
+	i64 reads;
+	i64 writes;
+	i64 hits;
+	i64 misses;
+	i64 coherence_misses;
+	i64 false_sharing;	// coherence misses on a word other than the one written
+	i64 upgrades;
+	i64 invalidations;	// lines taken away by other caches
+	i64 writebacks;		// modified lines evicted or downgraded
+} llsim_cache_t;
+
+typedef struct llsim_coherence_s {
+	struct llsim_memory_s *memory;
+	int line_words;
+	int nr_caches;
+	llsim_cache_t *caches[LLSIM_COH_MAX_CACHES];
+
+	// bus transactions
+	i64 bus_rd;
+	i64 bus_rdx;
+	i64 bus_upgr;
+	i64 external_writes;	// writes by agents without a cache (DMA)
+
+	// false sharing misses by line
+	int hot_line[LLSIM_COH_HOTSPOTS];
+	i64 hot_count[LLSIM_COH_HOTSPOTS];
+} llsim_coherence_t;
+
 /*
  * memory
  */
@@ -134,6 +237,9 @@ typedef struct llsim_memory_s {
 	int *datain;
 	int *dataout;
 
+	llsim_prefetcher_t *pf;
+	llsim_coherence_t *coh;
+
 	struct llsim_memory_s *next;
 } llsim_memory_t;
 
@@ -162,15 +268,40 @@ typedef struct llsim_input_s {
 	int bits;
 	void *oldp;
 	void *newp;
+	struct llsim_unit_s *source;	// unit declaring the matching output, NULL if none
+	int value;			// value seen by the last run
 	struct llsim_input_s *next;
 } llsim_input_t;
 
 /*
  * simulated unit
+ *
+ * quiescent() returns how many upcoming clocks the unit can be fast
+ * forwarded without running it (0 = must run, LLSIM_FOREVER = until another
+ * unit changes state). When every unit is quiescent the kernel jumps the
+ * clock and calls skip() so units can account for the skipped clocks.
+ *
+ * affinity names a unit that must be evaluated by the same host thread,
+ * for units that drive the ports of another unit's memory (NULL = any).
+ *
+ * An event_driven unit promises that once a run leaves its registers
+ * unchanged and its quiescent() (if any) says it waits for an event, its
+ * run() would change nothing until one of its declared inputs changes. The
+ * kernel then skips it, e.g. an idle DMA engine or a halted core.
  */
+#define LLSIM_FOREVER	0x7fffffff
+
 typedef struct llsim_unit_s {
 	char *name;
 	void (*run) (struct llsim_unit_s *unit);
+	int (*quiescent) (struct llsim_unit_s *unit);
+	void (*skip) (struct llsim_unit_s *unit, int clocks);
+	struct llsim_unit_s *affinity;
+	int thread;		// host thread evaluating the unit
+	int event_driven;
+	int settled;		// see llsim_unit_settled()
+	i64 runs;
+	i64 skipped_runs;
 	llsim_unit_registers_t *regs;
 	void *private;
 	llsim_memory_t *mems;
@@ -182,11 +313,21 @@ typedef struct llsim_unit_s {
 
 /*
  * chip simulator main structure
+ *
+ * With LLSIM_THREADS > 1 the units are evaluated by a pool of host threads.
+ * quantum is the number of clocks between thread syncs: 1 is cycle exact,
+ * larger values let the threads run ahead of each other (see llsim.c).
  */
 typedef struct llsim_s {
 	llsim_unit_t *units;
 	int clock;
 	int reset;
+	int threads;
+	int quantum;
+	i64 skipped_clocks;
+	i64 skips;
+	i64 syncs;
+	i64 skipped_runs;
 } llsim_t;
 
 llsim_t *llsim;
@@ -202,6 +343,8 @@ void llsim_register_wire(char *unit_name, char *wire_name, int bits, void *wirep
 void llsim_register_output(char *unit_name, char *output_name, int bits, void *oldp, void *newp);
 void llsim_register_input(char *unit_name, char *input_name, int bits, void *oldp, void *newp);
 void llsim_stop(void);
+void llsim_lock(void);
+void llsim_unlock(void);
 
 /*
  * memories
@@ -213,5 +356,26 @@ void llsim_mem_set_datain(llsim_memory_t *memory, int val, int msb, int lsb);
 void llsim_mem_write(llsim_memory_t *memory, int addr);
 void llsim_mem_read(llsim_memory_t *memory, int addr);
 int llsim_mem_extract_dataout(llsim_memory_t *memory, int msb, int lsb);
+
+/*
+ * prefetchers
+ */
+void llsim_pf_next_line_train(llsim_prefetcher_t *pf, int pc, int addr);
+void llsim_pf_stride_train(llsim_prefetcher_t *pf, int pc, int addr);
+llsim_prefetcher_t *llsim_allocate_prefetcher(llsim_memory_t *memory, char *name,
+	void (*train) (llsim_prefetcher_t *pf, int pc, int addr),
+	int line_words, int degree, int distance, int latency);
+void llsim_prefetch_access(llsim_memory_t *memory, int pc, int addr);
+void llsim_prefetch_dump(FILE *fp, llsim_memory_t *memory);
+
+/*
+ * coherent caches
+ */
+llsim_cache_t *llsim_allocate_cache(llsim_memory_t *memory, char *name, int lines, int line_words);
+int llsim_cache_hit(llsim_cache_t *cache, int addr, int write);
+int llsim_cache_access(llsim_cache_t *cache, int addr, int write);
+void llsim_coherence_write(llsim_memory_t *memory, int addr);
+void llsim_coherence_dump(FILE *fp, llsim_memory_t *memory);
+
 void llsim_run_clock(void);
 #endif
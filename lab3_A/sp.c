@@ -1,4 +1,5 @@
 ﻿#define _CRT_SECURE_NO_WARNINGS
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -13,12 +14,160 @@ static const char* SP_BUILD_TAG = "SP tracev2 " __DATE__ " " __TIME__;
 
 #define sp_printf(fmt, ...) \
     do { \
+        llsim_lock(); \
         llsim_printf("sp: clock %d: ", llsim->clock); \
         llsim_printf(fmt, ##__VA_ARGS__); \
+        llsim_unlock(); \
     } while (0)
 
-int nr_simulated_instructions = 0;
-FILE* inst_trace_fp = NULL, * cycle_trace_fp = NULL;
+// Hardware prefetchers: next-line on srami, PC-indexed stride on sramd loads
+#ifndef SP_PREFETCH
+#define SP_PREFETCH 0
+#endif
+#define SP_PREFETCH_LINE_WORDS  4
+#define SP_PREFETCH_DEGREE      1
+#define SP_PREFETCH_DISTANCE    1
+#define SP_PREFETCH_LATENCY     4
+
+// DMA engine: words moved per port cycle and sramd port arbitration policy
+#ifndef SP_DMA_BURST_WORDS
+#define SP_DMA_BURST_WORDS      1
+#endif
+#define SP_ARB_CORE_FIRST       0
+#define SP_ARB_DMA_FIRST        1
+#define SP_ARB_ROUND_ROBIN      2
+#ifndef SP_DMA_ARB_POLICY
+#define SP_DMA_ARB_POLICY       SP_ARB_CORE_FIRST
+#endif
+
+// Banked sramd: SP_SRAMD_BANKS word-interleaved banks (address % banks), each
+// with its own port. The arbiter grants the banks separately, so the cores and
+// the DMA go ahead in the same clock when they touch different banks and the
+// loser of a same-bank collision stalls. A DMA burst, a store buffer line or
+// a data cache line needs every bank one of its words is in. At most 32.
+#ifndef SP_SRAMD_BANKS
+#define SP_SRAMD_BANKS          1
+#endif
+
+// Multi-core: SP_NR_CORES cores with private srami share sramd through an
+// interconnect. A LD/ST spends SP_XBAR_LATENCY clocks in EXEC0 crossing it
+// before it competes for the sramd port.
+#ifndef SP_NR_CORES
+#define SP_NR_CORES             1
+#endif
+#ifndef SP_XBAR_LATENCY
+#define SP_XBAR_LATENCY         0
+#endif
+
+// Private MESI data caches over the shared sramd. A miss needs the sramd port
+// for its bus transaction and fills SP_DCACHE_MISS_LATENCY clocks after the
+// grant; hits leave the port free. Cached LD/ST don't pay SP_XBAR_LATENCY.
+#ifndef SP_DCACHE
+#define SP_DCACHE               0
+#endif
+#define SP_DCACHE_LINES         16
+#define SP_DCACHE_LINE_WORDS    4
+#define SP_DCACHE_MISS_LATENCY  4
+
+// Scratchpad and main memory: sramd addresses below SP_SCRATCH_WORDS are the
+// one-clock scratchpad, the rest is a pipelined main memory that answers
+// SP_MAIN_MEM_LATENCY clocks after a request. A LD/ST or a data cache miss to
+// main memory waits out the latency in EXEC0 before it takes the port. The
+// DMA waits once before it reads a block from main memory and once before it
+// completes a block written to it, words in between stream at the port rate.
+// sramd keeps holding the whole address space, loading and dumps don't change.
+#ifndef SP_MAIN_MEM
+#define SP_MAIN_MEM             0
+#endif
+#ifndef SP_SCRATCH_WORDS
+#define SP_SCRATCH_WORDS        16384
+#endif
+#ifndef SP_MAIN_MEM_LATENCY
+#define SP_MAIN_MEM_LATENCY     20
+#endif
+
+// Hardware multithreading: SP_NR_THREADS contexts per core, each with its own
+// registers and PC, share the pipeline. FETCH0 picks the thread to fetch from
+// every clock (round-robin), or stays on one thread until the pipeline stalls
+// or its branch flushes the front end (switch on stall). Hazards and flushes
+// only concern instructions of the same thread. A thread asleep in WFE is not
+// fetched from: its WFE leaves EXEC0 to the other threads and is fetched again
+// once the event arrives, it only waits in EXEC0 when no other thread is awake.
+#ifndef SP_NR_THREADS
+#define SP_NR_THREADS           1
+#endif
+#define SP_MT_ROUND_ROBIN       0
+#define SP_MT_SWITCH_ON_STALL   1
+#ifndef SP_MT_POLICY
+#define SP_MT_POLICY            SP_MT_ROUND_ROBIN
+#endif
+
+// Integer multiply/divide unit: MUL/DIV/MOD leave EXEC0 at once and their
+// result is written back SP_MUL_LATENCY / SP_DIV_LATENCY clocks later through
+// a second register file write port. The unit is iterative, one operation at
+// a time. Only dependents of the pending result stall in DEC1.
+#ifndef SP_MUL_LATENCY
+#define SP_MUL_LATENCY          3
+#endif
+#ifndef SP_DIV_LATENCY
+#define SP_DIV_LATENCY          16
+#endif
+
+// Macro-op fusion: DEC0 merges its instruction with the next one, waiting in
+// FETCH1, into one op that takes a single DEC1/EXEC0/EXEC1 slot. Fused are a
+// constant built with LHI and ADD/OR on the same register, and an ALU op
+// followed by a branch comparing its result with r0, the branch then
+// resolves a clock earlier.
+#ifndef SP_FUSION
+#define SP_FUSION               0
+#endif
+#define SP_FUSE_NONE            0
+#define SP_FUSE_CONST           1
+#define SP_FUSE_BRANCH          2
+
+// Early jumps: DEC0 sends FETCH0 to the target of an always-taken branch
+// (JEQ/JLE comparing a register with itself) and drops the two younger
+// fetches, instead of EXEC0 flushing four stages. Not done while the
+// thread's hardware loop is armed, FETCH0 counts its back-edges.
+#ifndef SP_DEC0_REDIRECT
+#define SP_DEC0_REDIRECT        0
+#endif
+
+// Loop buffer: a short backward branch taken by EXEC0 has the decoded
+// instructions of its loop captured as they leave DEC1. Once the buffer holds
+// the loop, a taken branch into it feeds DEC1 from the buffer, one instruction
+// a clock, while FETCH0 goes on after the end of the loop and waits there with
+// FETCH1 and DEC0 full. A back-edge then costs one bubble instead of four.
+// Single-threaded cores only, and not while the hardware loop is armed.
+#ifndef SP_LOOP_BUFFER
+#define SP_LOOP_BUFFER          0
+#endif
+#define SP_LOOP_BUFFER_WORDS    8
+
+// Load value prediction: a stride predictor indexed by the pc of the load
+// (a last-value one while the stride is 0). The dependent in DEC1 of a load
+// in EXEC0 takes the predicted value instead of stalling. In the next clock,
+// with the load in EXEC1, a wrong value drops the dependent from EXEC0 before
+// it does anything and refetches it, like a taken branch.
+#ifndef SP_LVP
+#define SP_LVP                  0
+#endif
+#define SP_LVP_ENTRIES          16
+#define SP_LVP_CONFIDENT        3
+
+// Store buffer: ST/STI leave EXEC0 into a queue of lines instead of taking the
+// sramd port, a store to the line at the tail of the queue is combined with
+// it. The oldest line is written, in one port cycle like a DMA burst, when
+// nobody else wants the port, or in its turn like an access once it has waited
+// SP_STORE_BUFFER_AGE clocks or EXEC0 waits for it. Loads take the youngest
+// buffered value of their word. FAA/CAS, DMA commands, WFE and HLT wait in
+// EXEC0 for the queue to empty. Not used with direct sramd access.
+#ifndef SP_STORE_BUFFER
+#define SP_STORE_BUFFER         0
+#endif
+#define SP_STORE_BUFFER_ENTRIES     4
+#define SP_STORE_BUFFER_LINE_WORDS  4
+#define SP_STORE_BUFFER_AGE         16
 
 // Opcodes
 #define ADD 0
@@ -31,41 +180,79 @@ FILE* inst_trace_fp = NULL, * cycle_trace_fp = NULL;
 #define LHI 7
 #define LD  8
 #define ST  9
+#define DMA_START  10   // R[src0] = src addr, R[src1] = dst addr, imm = length
+#define DMA_STATUS 11   // R[dst] := DMA busy (imm 0) or completion flag (imm 1)
+#define DMA_DOORBELL 12 // R[src0] = address of the first descriptor
+#define WFE 13          // wait until an event (DMA completion) is pending for the thread
+#define CPUID 14        // R[dst] := context id (imm 0) or number of contexts (imm 1)
+#define FAA 15          // R[dst] := MEM[R[src1]], MEM[R[src1]] += R[src0], atomically
 #define JLT 16
 #define JLE 17
 #define JEQ 18
 #define JNE 19
 #define JIN 20
+#define CAS 21          // R[dst] := MEM[R[src1]], MEM[R[src1]] := R[src0] if it was R[dst], atomically
+#define MUL 22          // R[dst] := R[src0] * R[src1], low 32 bits
+#define DIV 23          // R[dst] := R[src0] / R[src1], signed, -1 on division by zero
 #define HLT 24
+#define MOD 25          // R[dst] := R[src0] % R[src1], signed, R[src0] on division by zero
+#define SIMD 26         // R[dst] := packed operation imm[3:0] on R[src0], R[src1]
+#define LOOP 27         // run PC+1..imm R[src0] times (skipped if R[src0] <= 0)
+#define LDI 28          // R[dst] := MEM[R[src1]], R[src1] += imm
+#define STI 29          // MEM[R[src1]] := R[src0], R[src1] += imm
+
+// SIMD operations (imm[3:0]), 4x8 bit unsigned or 2x16 bit signed lanes
+#define SIMD_ADDB    0  // wrapping add
+#define SIMD_SUBB    1  // wrapping subtract
+#define SIMD_ADDUSB  2  // unsigned saturating add
+#define SIMD_MINUB   3
+#define SIMD_MAXUB   4
+#define SIMD_ADDH    5  // wrapping add
+#define SIMD_SUBH    6  // wrapping subtract
+#define SIMD_ADDSH   7  // signed saturating add
+#define SIMD_MINH    8
+#define SIMD_MAXH    9
+#define SIMD_SHUFB  10  // byte i := R[src0] byte imm[9+2i:8+2i]
+#define SIMD_SUMB   11  // R[src1] + the four bytes of R[src0]
 
 static char opcode_name[32][4] = { "ADD", "SUB", "LSF", "RSF", "AND", "OR", "XOR", "LHI",
-                 "LD", "ST", "U", "U", "U", "U", "U", "U",
-                 "JLT", "JLE", "JEQ", "JNE", "JIN", "U", "U", "U",
-                 "HLT", "U", "U", "U", "U", "U", "U", "U" };
+                 "LD", "ST", "DMS", "DMT", "DMB", "WFE", "CID", "FAA",
+                 "JLT", "JLE", "JEQ", "JNE", "JIN", "CAS", "MUL", "DIV",
+                 "HLT", "MOD", "SMD", "LP", "LDI", "STI", "U", "U" };
 
 typedef struct sp_registers_s {
-    // 6 32 bit registers (r[0], r[1] don't exist)
-    int r[8];
+    // 6 32 bit registers per thread (r[0], r[1] don't exist)
+    int r[SP_NR_THREADS][8];
+
+    // hardware threads
+    int thread_pc[SP_NR_THREADS]; // 16 bits, next fetch of a thread not in FETCH0
+    int thread_halted[SP_NR_THREADS]; // 1 bit, HLT committed
+    int fetch_thread; // 2 bits, thread FETCH0 fetched from last
+    int mt_switch; // 1 bit, switch on stall: leave fetch_thread at the next fetch
 
     // 32 bit cycle counter
     int cycle_counter;
 
     // fetch0
     int fetch0_active; // 1 bit
+    int fetch0_thread; // 2 bits
     int fetch0_pc; // 16 bits
 
     // fetch1
     int fetch1_active; // 1 bit
+    int fetch1_thread; // 2 bits
     int fetch1_pc; // 16 bits
     int fetch1_inst; // 32 bits
 
     // dec0
     int dec0_active; // 1 bit
+    int dec0_thread; // 2 bits
     int dec0_pc; // 16 bits
     int dec0_inst; // 32 bits
 
     // dec1
     int dec1_active; // 1 bit
+    int dec1_thread; // 2 bits
     int dec1_pc; // 16 bits
     int dec1_inst; // 32 bits
     int dec1_opcode; // 5 bits
@@ -75,10 +262,13 @@ typedef struct sp_registers_s {
     int dec1_immediate; // 32 bits
     int dec1_alu0; // 32 bits
     int dec1_alu1; // 32 bits
+    int dec1_fused; // 2 bits, SP_FUSE_* kind of the pair
+    int dec1_inst2; // 32 bits, second instruction of the pair (at pc + 1)
+    int dec1_redirected; // 1 bit, DEC0 already sent FETCH0 to the target
 
     // exec0
     int exec0_active; // 1 bit
-
+    int exec0_thread; // 2 bits
     int exec0_pc; // 16 bits
     int exec0_inst; // 32 bits
     int exec0_opcode; // 5 bits
@@ -88,10 +278,17 @@ typedef struct sp_registers_s {
     int exec0_immediate; // 32 bits
     int exec0_alu0; // 32 bits
     int exec0_alu1; // 32 bits
+    int exec0_alu2; // 32 bits, CAS expected value R[dst]
     int exec0_aluout; // 32 bits
+    int exec0_fused; // 2 bits
+    int exec0_inst2; // 32 bits
+    int exec0_redirected; // 1 bit
+    int exec0_lvp; // 1 bit, an operand is the predicted value of the load in EXEC1
+    int exec0_lvp_value; // 32 bits
 
     // exec1
     int exec1_active; // 1 bit
+    int exec1_thread; // 2 bits
     int exec1_pc; // 16 bits
     int exec1_inst; // 32 bits
     int exec1_opcode; // 5 bits
@@ -101,25 +298,106 @@ typedef struct sp_registers_s {
     int exec1_immediate; // 32 bits
     int exec1_alu0; // 32 bits
     int exec1_alu1; // 32 bits
-    int exec1_aluout; // 32 bits
-
-    // DMA registers
-    int dma_start;
-    int dma_len;
-    int dma_busy;
-    int dma_done;
-    int dma_src_addr;
-    int dma_dst_addr;
-    int dma_counter;
+    int exec1_aluout; // 32 bits, R[dst] after both instructions of a fused pair
+    int exec1_fused; // 2 bits
+    int exec1_inst2; // 32 bits
+    int exec1_sb_fwd; // 1 bit, the LD value is exec1_aluout, from the store buffer
+
+    // DMA command latch. dma_cmd counts the commands, one is pending until the
+    // dma unit has taken as many, so it is never missed however late the unit
+    // looks at it (units on other host threads in relaxed mode).
+    int dma_cmd; // 8 bits
+    int dma_chain; // 1 bit, dma_src_addr holds a descriptor address
+    int dma_len; // 16 bits
+    int dma_src_addr; // 16 bits
+    int dma_dst_addr; // 16 bits
+
+    // events
+    int event_reg[SP_NR_THREADS]; // 1 bit, sticky, consumed by the thread's WFE
+    int dma_events; // 8 bits, DMA completions seen
+    int wfe_sleep[SP_NR_THREADS]; // 1 bit, the thread waits in WFE
+
+    // interconnect
+    int exec0_xbar_wait; // clocks the EXEC0 LD/ST has spent crossing the interconnect and main memory
+
+    // data cache access of the EXEC0 LD/ST
+    int exec0_dc_state; // 2 bits
+#define SP_DC_PROBE 0
+#define SP_DC_MISS  1
+#define SP_DC_FILL  2
+    int exec0_dc_fill; // clocks until the line arrives
+    int exec0_dc_coh; // 1 bit, the miss was caused by coherence traffic
+
+    // atomic read-modify-write of the EXEC0 FAA/CAS: the read port cycle
+    // locks the sramd port for the write in the next one
+    int exec0_amo_phase; // 1 bit, 0 = read, 1 = write
+    int exec0_amo_old; // 32 bits, value read
+
+    // hardware loop of each thread: FETCH0 goes back from lp_end to lp_start
+    // lp_fetch more times, lp_exec counts the back-edges EXEC0 has yet to
+    // see and resynchronizes lp_fetch when a branch flushes the front end
+    int lp_start[SP_NR_THREADS]; // 16 bits
+    int lp_end[SP_NR_THREADS]; // 16 bits
+    int lp_fetch[SP_NR_THREADS]; // 16 bits
+    int lp_exec[SP_NR_THREADS]; // 16 bits
+
+    // loop buffer: decoded instructions of lb_start..lb_end (thread 0), DEC1
+    // takes them from lb_pc on while lb_stream is set
+    int lb_loaded; // 1 bit, lb_start..lb_end allocated
+    int lb_start; // 16 bits
+    int lb_end; // 16 bits
+    int lb_stream; // 1 bit
+    int lb_pc; // 16 bits
+    int lb_refill; // 1 bit, the stream has ended, DEC0 is to go on after it
+    struct {
+        int valid; // 1 bit
+        int inst; // 32 bits
+        int opcode; // 5 bits
+        int src0; // 3 bits
+        int src1; // 3 bits
+        int dst; // 3 bits
+        int immediate; // 32 bits
+        int fused; // 2 bits
+        int inst2; // 32 bits
+    } lb[SP_LOOP_BUFFER_WORDS];
+
+    // store buffer: lines sb_head .. sb_head + sb_count - 1, oldest first
+    int sb_head; // 2 bits
+    int sb_count; // 3 bits
+    int sb_age; // clocks the oldest line has waited for the port
+    struct {
+        int line; // 14 bits, address / SP_STORE_BUFFER_LINE_WORDS
+        int mask; // SP_STORE_BUFFER_LINE_WORDS bits, words written
+        int data[SP_STORE_BUFFER_LINE_WORDS];
+    } sb[SP_STORE_BUFFER_ENTRIES];
+
+    // load value predictor
+    struct {
+        int tag; // 16 bits, pc of the load
+        int last; // 32 bits, value it loaded last
+        int stride; // 32 bits
+        int conf; // 2 bits, saturating count of repeated strides
+    } lvp[SP_LVP_ENTRIES];
+
+    // multiply/divide unit
+    int mdu_busy; // 5 bits, clocks until the result is written back
+    int mdu_thread; // 2 bits
+    int mdu_dst; // 3 bits
+    int mdu_value; // 32 bits
+
+    int halted; // 1 bit, HLT committed by every thread, the core no longer runs
 } sp_registers_t;
 
 /*
  * Master structure
  */
 typedef struct sp_s {
-    // local srams
+    int id;
+
+    // local srami, sramd is shared by all the cores
 #define SP_SRAM_HEIGHT    64 * 1024
     llsim_memory_t* srami, * sramd;
+    llsim_cache_t* dcache;
 
     unsigned int memory_image[SP_SRAM_HEIGHT];
     int memory_image_size;
@@ -128,23 +406,681 @@ typedef struct sp_s {
 
     sp_registers_t* spro, * sprn;
 
+    struct dma_s* dma;
+
     // Hazard detection signals
     int stall;
     int flush;
+    int exec0_stall; // EXEC0 holds its instruction (sramd port lost, DMA busy)
 
     // Branch prediction
     int branch_taken;
     int branch_target;
+    int dec0_redirect; // DEC0 sends its thread to dec0_target
+    int dec0_target;
+    int lb_hit; // EXEC0 branches into the loop buffer
+
+    // Load value prediction signals
+    int lvp_forward; // DEC1 takes lvp_value, the prediction for the EXEC0 load
+    int lvp_value;
+    int lvp_replay; // the EXEC0 instruction took a wrong one and goes again
+
+    int wfe_park; // the EXEC0 WFE sleeps out of the pipeline and goes again on its event
 
     // Forwarding signals
     int forward_alu0;
     int forward_alu1;
+    int forward_alu2;
     int forward_value_alu0;
     int forward_value_alu1;
+    int forward_value_alu2;
+
+    // traces
+    FILE* inst_trace_fp, * cycle_trace_fp;
+    int nr_simulated_instructions;
+
+    // statistics
+    int halt_cycle;
+    int thread_halt_cycle[SP_NR_THREADS];
+    int thread_instructions[SP_NR_THREADS];
+    i64 exec0_stall_cycles;
+    i64 idle_cycles; // sleeping in WFE
+    i64 xbar_cycles; // LD/ST crossing the interconnect
+    i64 mm_accesses; // LD/ST/FAA/CAS to main memory
+    i64 mm_cycles; // clocks they waited for it
+    i64 port_lost_cycles; // LD/ST lost the sramd port to another core or the DMA
+    i64 dcache_stall_cycles; // LD/ST waiting for a data cache miss
+    i64 coherence_stall_cycles; // part of them caused by coherence misses and upgrades
+    i64 mdu_ops;
+    i64 loop_back_edges; // taken by FETCH0 without a flush
+    i64 mdu_dep_stall_cycles; // DEC1 waiting for a MUL/DIV/MOD result
+    i64 mdu_busy_stall_cycles; // MUL/DIV/MOD waiting for the unit
+    i64 fused_const; // committed LHI + ADD/OR pairs
+    i64 fused_branch; // committed ALU + branch pairs
+    i64 dec0_redirects; // jumps taken by DEC0
+    i64 exec0_flushes; // branches taken by EXEC0
+    i64 lb_captures; // loops allocated in the loop buffer
+    i64 lb_hits; // taken branches streamed from it
+    i64 lb_misses;
+    i64 lb_streamed; // instructions DEC1 took from it
+    i64 lb_refill_bubbles; // DEC1 waiting for DEC0 after a stream
+    i64 lvp_loads; // committed LD/LDI
+    i64 lvp_predicted; // of them with a confident prediction
+    i64 lvp_correct;
+    i64 lvp_used; // load-use stalls replaced by a prediction
+    i64 lvp_replays;
+    i64 port_cycles; // sramd port cycles of EXEC0 accesses
+    i64 sb_stores; // ST/STI into the store buffer
+    i64 sb_combined; // of them combined with the line at the tail
+    i64 sb_forwarded; // loads served by it
+    i64 sb_drains; // lines written to sramd
+    i64 sb_full_cycles; // ST waiting for a free line
+    i64 sb_fence_cycles; // EXEC0 waiting for it to empty
+    i64 sb_occupancy; // lines held, summed over the clocks
+    int sb_max_occupancy;
+    i64 bank_conflict_cycles; // lost the port to a requester of the same bank
+    i64 bank_shared_cycles; // had the port while another requester had another bank
 } sp_t;
 
+static sp_t* sp_cores[SP_NR_CORES];
+static int sp_halted_cores;
+
+// Core registers the DMA engine looks at: its command latch and what the
+// sramd port arbiter needs. Declared as core outputs and DMA inputs so an
+// idle engine only runs when one of them moves.
+static const struct {
+    char* name;
+    int offset;
+    int bits;
+} sp_dma_ports[] = {
+    { "halted",          offsetof(sp_registers_t, halted),          1 },
+    { "dma_cmd",         offsetof(sp_registers_t, dma_cmd),         8 },
+    { "exec0_active",    offsetof(sp_registers_t, exec0_active),    1 },
+    { "exec0_opcode",    offsetof(sp_registers_t, exec0_opcode),    5 },
+    { "exec0_xbar_wait", offsetof(sp_registers_t, exec0_xbar_wait), 16 },
+    { "exec0_dc_state",  offsetof(sp_registers_t, exec0_dc_state),  2 },
+    { "exec0_amo_phase", offsetof(sp_registers_t, exec0_amo_phase), 1 },
+    { "exec0_alu1",      offsetof(sp_registers_t, exec0_alu1),      16 },
+    { "sb_head",         offsetof(sp_registers_t, sb_head),         16 },
+    { "sb_count",        offsetof(sp_registers_t, sb_count),        16 },
+    { "sb_age",          offsetof(sp_registers_t, sb_age),          16 },
+};
+#define SP_NR_DMA_PORTS (int)(sizeof(sp_dma_ports) / sizeof(sp_dma_ports[0]))
+
+// Atomics by address: operations, CAS failures (software retries) and
+// clocks lost waiting for the sramd port. The last entry collects the
+// addresses that don't fit. Shared by the cores, updated under llsim_lock().
+#define SP_AMO_STATS 16
+
+typedef struct sp_amo_stat_s {
+    int addr;
+    i64 ops;
+    i64 cas_fails;
+    i64 wait_cycles;
+} sp_amo_stat_t;
+
+static sp_amo_stat_t sp_amo_stats[SP_AMO_STATS];
+static int sp_nr_amo_stats;
+
+static sp_amo_stat_t* sp_amo_stat(int addr)
+{
+    int i;
+
+    for (i = 0; i < sp_nr_amo_stats; i++)
+        if (sp_amo_stats[i].addr == addr)
+            return &sp_amo_stats[i];
+    if (sp_nr_amo_stats == SP_AMO_STATS - 1) {
+        sp_amo_stats[SP_AMO_STATS - 1].addr = -1;
+        return &sp_amo_stats[SP_AMO_STATS - 1];
+    }
+    sp_amo_stats[sp_nr_amo_stats].addr = addr;
+    return &sp_amo_stats[sp_nr_amo_stats++];
+}
+
+// Word a successful atomic in EXEC0 leaves in memory
+static int sp_amo_value(sp_registers_t* spro, int old)
+{
+    return (spro->exec0_opcode == FAA) ? old + spro->exec0_alu0 : spro->exec0_alu0;
+}
+
+static int sp_is_mdu(int opcode)
+{
+    return opcode == MUL || opcode == DIV || opcode == MOD;
+}
+
+// LD/ST with or without the post-increment
+static int sp_is_load(int opcode)
+{
+    return opcode == LD || opcode == LDI;
+}
+
+static int sp_is_store(int opcode)
+{
+    return opcode == ST || opcode == STI;
+}
+
+// Register a post-increment LD/ST writes the next address to (second
+// write-back port), 0 if none
+static int sp_inc_reg(int opcode, int src1)
+{
+    return ((opcode == LDI || opcode == STI) && src1 >= 2) ? src1 : 0;
+}
+
+static int sp_mdu_result(int opcode, int a, int b)
+{
+    switch (opcode) {
+    case MUL:
+        return (int)((uint32_t)a * (uint32_t)b);
+    case DIV:
+        if (b == 0)
+            return -1;
+        if (a == INT32_MIN && b == -1)
+            return a;
+        return a / b;
+    default:
+        if (b == 0)
+            return a;
+        if (a == INT32_MIN && b == -1)
+            return 0;
+        return a % b;
+    }
+}
+
+static int sp_alu_result(int opcode, int a, int b, int imm)
+{
+    switch (opcode) {
+    case ADD: return a + b;
+    case SUB: return a - b;
+    case LSF: return (int)((uint32_t)a << (b & 31));
+    case RSF: return (int)((uint32_t)a >> (b & 31));
+    case AND: return a & b;
+    case OR:  return a | b;
+    case XOR: return a ^ b;
+    case LHI: return (int)((((uint32_t)imm & 0xFFFF) << 16) | (a & 0xFFFF));
+    default:  return 0;
+    }
+}
+
+// Fusion pairs: the second instruction reads only the register the first
+// one writes, r0 and its own immediate
+static int sp_fuse_kind(int inst, int next)
+{
+    int op = (inst >> 25) & 0x1F, dst = (inst >> 22) & 0x07;
+    int op2 = (next >> 25) & 0x1F, dst2 = (next >> 22) & 0x07;
+    int src0 = (next >> 19) & 0x07, src1 = (next >> 16) & 0x07;
+
+    if (dst < 2 || op > LHI || (src0 != dst && src1 != dst))
+        return SP_FUSE_NONE;
+    if ((op == LHI || op == ADD || op == OR) && (op2 == LHI || op2 == ADD || op2 == OR) &&
+        (op == LHI || op2 == LHI) && dst2 == dst &&
+        (src0 == dst || src0 <= 1) && (src1 == dst || src1 <= 1))
+        return SP_FUSE_CONST;
+    // the immediate of a branch is its target, taken branches write r7
+    if (op2 >= JLT && op2 <= JNE && dst != 7 &&
+        (src0 == dst || src0 == 0) && (src1 == dst || src1 == 0))
+        return SP_FUSE_BRANCH;
+    return SP_FUSE_NONE;
+}
+
+// An operand of the second instruction, R[dst] being "value"
+static int sp_fuse_operand(int src, int inst2, int dst, int value)
+{
+    return (src == dst) ? value : (src == 1) ? (int16_t)(inst2 & 0xFFFF) : 0;
+}
+
+// R[dst] after the pair, "value" is the result of the first instruction
+static int sp_fused_result(int kind, int inst2, int dst, int value)
+{
+    if (kind != SP_FUSE_CONST)
+        return value;
+    return sp_alu_result((inst2 >> 25) & 0x1F, sp_fuse_operand((inst2 >> 19) & 0x07, inst2, dst, value),
+        sp_fuse_operand((inst2 >> 16) & 0x07, inst2, dst, value), inst2 & 0xFFFF);
+}
+
+// The branch of an ALU + branch pair is taken
+static int sp_fused_taken(int inst2, int dst, int value)
+{
+    int a = sp_fuse_operand((inst2 >> 19) & 0x07, inst2, dst, value);
+    int b = sp_fuse_operand((inst2 >> 16) & 0x07, inst2, dst, value);
+
+    switch ((inst2 >> 25) & 0x1F) {
+    case JLT: return a < b;
+    case JLE: return a <= b;
+    case JEQ: return a == b;
+    default:  return a != b;
+    }
+}
+
+static const char* simd_name[16] = { "ADDB", "SUBB", "ADDUSB", "MINUB", "MAXUB", "ADDH", "SUBH",
+    "ADDSH", "MINH", "MAXH", "SHUFB", "SUMB", "U", "U", "U", "U" };
+
+// Packed operation imm[3:0] of a SIMD instruction, lane by lane
+static int sp_simd_result(int imm, int a, int b)
+{
+    uint32_t res = 0;
+    int i, x, y, r;
+
+    switch (imm & 0xF) {
+    case SIMD_ADDB: case SIMD_SUBB: case SIMD_ADDUSB: case SIMD_MINUB: case SIMD_MAXUB:
+        for (i = 0; i < 32; i += 8) {
+            x = ((uint32_t)a >> i) & 0xFF;
+            y = ((uint32_t)b >> i) & 0xFF;
+            switch (imm & 0xF) {
+            case SIMD_ADDB:   r = x + y; break;
+            case SIMD_SUBB:   r = x - y; break;
+            case SIMD_ADDUSB: r = (x + y > 0xFF) ? 0xFF : x + y; break;
+            case SIMD_MINUB:  r = (x < y) ? x : y; break;
+            default:          r = (x > y) ? x : y; break;
+            }
+            res |= (uint32_t)(r & 0xFF) << i;
+        }
+        return (int)res;
+
+    case SIMD_ADDH: case SIMD_SUBH: case SIMD_ADDSH: case SIMD_MINH: case SIMD_MAXH:
+        for (i = 0; i < 32; i += 16) {
+            x = (int16_t)((uint32_t)a >> i);
+            y = (int16_t)((uint32_t)b >> i);
+            switch (imm & 0xF) {
+            case SIMD_ADDH:  r = x + y; break;
+            case SIMD_SUBH:  r = x - y; break;
+            case SIMD_ADDSH: r = (x + y > INT16_MAX) ? INT16_MAX : (x + y < INT16_MIN) ? INT16_MIN : x + y; break;
+            case SIMD_MINH:  r = (x < y) ? x : y; break;
+            default:         r = (x > y) ? x : y; break;
+            }
+            res |= (uint32_t)(r & 0xFFFF) << i;
+        }
+        return (int)res;
+
+    case SIMD_SHUFB:
+        for (i = 0; i < 4; i++)
+            res |= (((uint32_t)a >> (8 * ((imm >> (8 + 2 * i)) & 3))) & 0xFF) << (8 * i);
+        return (int)res;
+
+    case SIMD_SUMB:
+        return b + (a & 0xFF) + ((a >> 8) & 0xFF) + ((a >> 16) & 0xFF) + (((uint32_t)a >> 24) & 0xFF);
+
+    default:
+        return 0;
+    }
+}
+
+// Every hardware thread looks like a core of its own to software
+static int sp_cpuid(sp_t* sp, int sel, int thread)
+{
+    return (sel == 1) ? SP_NR_CORES * SP_NR_THREADS : sp->id * SP_NR_THREADS + thread;
+}
+
+/*
+ * DMA engine
+ *
+ * A separate llsim unit that shares the sramd port with EXEC0 LD/ST. Every
+ * burst takes a READ and a WRITE port cycle, each granted by the arbiter.
+ *
+ * In chained mode (DMA_DOORBELL) the engine walks a list of descriptors in
+ * sramd, fetching one descriptor word per port cycle:
+ *   word 0  source address
+ *   word 1  destination address
+ *   word 2  length in words
+ *   word 3  stride: bits 15:0 source, bits 31:16 destination (0 means 1)
+ *   word 4  address of the next descriptor, 0 ends the chain
+ */
+#define DMA_DESC_WORDS 5
+
+typedef struct dma_registers_s {
+    int state; // 3 bits
+#define DMA_STATE_IDLE  0
+#define DMA_STATE_READ  1
+#define DMA_STATE_WRITE 2
+#define DMA_STATE_DESC  3
+#define DMA_STATE_MM    4 // waiting for main memory
+    int src; // 16 bits
+    int dst; // 16 bits
+    int remaining; // 16 bits
+    int src_stride; // 16 bits
+    int dst_stride; // 16 bits
+    int burst; // words held in buf
+    int buf[SP_DMA_BURST_WORDS]; // 32 bits each
+    int desc_addr; // 16 bits, descriptor being fetched
+    int desc_word; // 3 bits, next descriptor word to fetch
+    int next; // 16 bits, next descriptor (0 = end of chain)
+    int mm_wait; // clocks left for main memory
+    int mm_end; // 1 bit, the wait completes the block rather than starts it
+    int done; // 1 bit, sticky completion flag
+    int events; // 8 bits, counts completions, a core that hasn't seen the last one has an event
+    int cmd_taken[SP_NR_CORES]; // 8 bits, commands taken from each core
+    int arb_last; // last winner of a contended port cycle
+    int core_last; // last core granted the port
+} dma_registers_t;
+
+typedef struct dma_s {
+    sp_t* sp;
+    dma_registers_t* dmaro, * dmarn;
+
+    // statistics
+    i64 busy_cycles;
+    i64 words;
+    i64 descriptors;
+    i64 stolen_cycles;  // DMA won the port while EXEC0 wanted it
+    i64 stalled_cycles; // DMA lost the port to EXEC0
+    i64 port_cycles;
+    i64 mm_cycles; // waiting for main memory
+    i64 bank_shared_cycles; // had the port while a core had another bank
+} dma_t;
+
+#define SP_PORT_NONE 0
+#define SP_PORT_DMA  1
+#define SP_PORT_CORE 2 // core i is granted SP_PORT_CORE + i
+
+// In relaxed parallel simulation (llsim quantum > 1) the cores may run on
+// different host threads up to a quantum apart and can't take turns on the
+// sramd port. They read and write sramd directly, as through the data
+// cache, and contention between the cores is not modeled.
+static int sp_relaxed(void)
+{
+    return llsim->quantum > 1;
+}
+
+static int sp_main_mem(int addr)
+{
+    return SP_MAIN_MEM && (addr & 0xFFFF) >= SP_SCRATCH_WORDS;
+}
+
+// Clocks the EXEC0 LD/ST/FAA/CAS spends on its way before it takes the port
+static int sp_access_latency(sp_registers_t* spro)
+{
+    return SP_XBAR_LATENCY + (sp_main_mem(spro->exec0_alu1) ? SP_MAIN_MEM_LATENCY : 0);
+}
+
+static int sp_direct_sramd(void)
+{
+    return SP_DCACHE || sp_relaxed();
+}
+
+// sramd has a single llsim port. With banks, the units granted different
+// banks of it in the same clock read and write it directly.
+static int sp_banked(void)
+{
+    return SP_SRAMD_BANKS > 1;
+}
+
+// Banks of words addr, addr + stride, ... one bit per bank
+static unsigned sp_bank_mask(int addr, int words, int stride)
+{
+    unsigned mask = 0;
+    int i;
+
+    for (i = 0; i < words; i++)
+        mask |= 1u << (((addr + i * stride) & 0xFFFF) % SP_SRAMD_BANKS);
+    return mask;
+}
+
+static int sp_sb_on(void)
+{
+    return SP_STORE_BUFFER && !sp_direct_sramd();
+}
+
+// Store buffer line with the youngest value of addr, -1 if there is none
+static int sp_sb_find(sp_registers_t* spro, int addr)
+{
+    int i, e;
+
+    for (i = spro->sb_count - 1; i >= 0; i--) {
+        e = (spro->sb_head + i) % SP_STORE_BUFFER_ENTRIES;
+        if (spro->sb[e].line == addr / SP_STORE_BUFFER_LINE_WORDS &&
+            ((spro->sb[e].mask >> (addr % SP_STORE_BUFFER_LINE_WORDS)) & 1))
+            return e;
+    }
+    return -1;
+}
+
+// The store buffer takes a store to addr: a line is free or the tail one is
+// the store's
+static int sp_sb_accepts(sp_registers_t* spro, int addr)
+{
+    return spro->sb_count < SP_STORE_BUFFER_ENTRIES ||
+        spro->sb[(spro->sb_head + spro->sb_count - 1) % SP_STORE_BUFFER_ENTRIES].line ==
+        addr / SP_STORE_BUFFER_LINE_WORDS;
+}
+
+// EXEC0 holds an instruction that waits for the store buffer to empty
+static int sp_sb_fence(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+
+    if (!sp_sb_on() || !spro->sb_count || !spro->exec0_active)
+        return 0;
+    switch (spro->exec0_opcode) {
+    case FAA: case CAS: case DMA_START: case DMA_DOORBELL: case WFE: case HLT:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// The LD/ST in EXEC0 is done in the store buffer, without the port
+static int sp_sb_serves(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+
+    if (!sp_sb_on() || !spro->exec0_active)
+        return 0;
+    if (sp_is_load(spro->exec0_opcode))
+        return sp_sb_find(spro, spro->exec0_alu1 & 0xFFFF) >= 0;
+    if (sp_is_store(spro->exec0_opcode))
+        return sp_sb_accepts(spro, spro->exec0_alu1 & 0xFFFF);
+    return 0;
+}
+
+// The oldest line of the store buffer can't wait for an idle port cycle
+static int sp_sb_must_drain(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+
+    if (!sp_sb_on() || !spro->sb_count)
+        return 0;
+    return spro->sb_age >= SP_STORE_BUFFER_AGE || sp_sb_fence(sp) ||
+        (spro->exec0_active && sp_is_store(spro->exec0_opcode) && !sp_sb_serves(sp));
+}
+
+static int sp_core_wants_port(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+
+    if (spro->halted || sp_relaxed())
+        return 0;
+    if (sp_sb_must_drain(sp))
+        return 1;
+    if (!spro->exec0_active || sp_sb_serves(sp))
+        return 0;
+    switch (spro->exec0_opcode) {
+    case LD: case ST: case LDI: case STI:
+        if (SP_DCACHE)
+            return spro->exec0_dc_state == SP_DC_MISS;
+        return spro->exec0_xbar_wait >= sp_access_latency(spro);
+    case FAA: case CAS:
+        return spro->exec0_xbar_wait >= sp_access_latency(spro);
+    default:
+        return 0;
+    }
+}
+
+// The second port cycle of an atomic
+static int sp_core_holds_port(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+
+    return sp_core_wants_port(sp) && (spro->exec0_opcode == FAA || spro->exec0_opcode == CAS) &&
+        spro->exec0_amo_phase == 1;
+}
+
+static int dma_wants_port(dma_t* dma)
+{
+    return dma->dmaro->state != DMA_STATE_IDLE && dma->dmaro->state != DMA_STATE_MM;
+}
+
+// Burst the DMA moves in its next READ cycle. A wide burst only makes sense
+// on contiguous blocks.
+static int dma_next_burst(dma_registers_t* dmaro)
+{
+    int burst = (dmaro->src_stride == 1 && dmaro->dst_stride == 1) ? SP_DMA_BURST_WORDS : 1;
+
+    return dmaro->remaining < burst ? dmaro->remaining : burst;
+}
+
+// Banks the DMA needs this clock
+static unsigned dma_banks(dma_t* dma)
+{
+    dma_registers_t* dmaro = dma->dmaro;
+
+    switch (dmaro->state) {
+    case DMA_STATE_DESC:
+        return sp_bank_mask(dmaro->desc_addr + dmaro->desc_word, 1, 1);
+    case DMA_STATE_READ:
+        return sp_bank_mask(dmaro->src, dma_next_burst(dmaro), dmaro->src_stride);
+    case DMA_STATE_WRITE:
+        return sp_bank_mask(dmaro->dst, dmaro->burst, dmaro->dst_stride);
+    default:
+        return 0;
+    }
+}
+
+// Banks the core needs this clock: the oldest store buffer line when it is
+// written, else the word (or data cache line) of the EXEC0 access
+static unsigned sp_core_banks(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+    int addr = spro->exec0_alu1 & 0xFFFF;
+
+    if (sp_sb_must_drain(sp) || (spro->sb_count && !sp_core_wants_port(sp)))
+        return sp_bank_mask(spro->sb[spro->sb_head].line * SP_STORE_BUFFER_LINE_WORDS,
+            SP_STORE_BUFFER_LINE_WORDS, 1);
+    if (SP_DCACHE && (sp_is_load(spro->exec0_opcode) || sp_is_store(spro->exec0_opcode)))
+        return sp_bank_mask(addr - addr % SP_DCACHE_LINE_WORDS, SP_DCACHE_LINE_WORDS, 1);
+    return sp_bank_mask(addr, 1, 1);
+}
+
+static unsigned sp_port_banks(dma_t* dma, int who)
+{
+    return who == SP_PORT_DMA ? dma_banks(dma) : sp_core_banks(sp_cores[who - SP_PORT_CORE]);
+}
+
+// A core wants one of the banks the DMA wants
+static int dma_contended(dma_t* dma)
+{
+    unsigned banks = dma_banks(dma);
+    int i;
+
+    for (i = 0; i < SP_NR_CORES; i++)
+        if (sp_core_wants_port(sp_cores[i]) && (sp_core_banks(sp_cores[i]) & banks))
+            return 1;
+    return 0;
+}
+
+// Requesters of the sramd port, highest priority first. An atomic that got
+// its read cycle keeps the port for its write. The cores take turns among
+// themselves and compete with the DMA as one party, the store buffers of the
+// cores that don't want the port come last.
+static int sp_port_requests(dma_t* dma, int* order)
+{
+    int eng = dma_wants_port(dma), dma_first = 0;
+    int i, id, n = 0;
+
+    for (i = 0; i < SP_NR_CORES; i++)
+        if (sp_core_holds_port(sp_cores[i]))
+            order[n++] = SP_PORT_CORE + i;
+    if (eng && (SP_DMA_ARB_POLICY == SP_ARB_DMA_FIRST ||
+        (SP_DMA_ARB_POLICY == SP_ARB_ROUND_ROBIN && dma->dmaro->arb_last != SP_PORT_DMA))) {
+        order[n++] = SP_PORT_DMA;
+        dma_first = 1;
+    }
+    for (i = 1; i <= SP_NR_CORES; i++) {
+        id = (dma->dmaro->core_last + i) % SP_NR_CORES;
+        if (sp_core_wants_port(sp_cores[id]) && !sp_core_holds_port(sp_cores[id]))
+            order[n++] = SP_PORT_CORE + id;
+    }
+    if (eng && !dma_first)
+        order[n++] = SP_PORT_DMA;
+    for (i = 1; i <= SP_NR_CORES; i++) {
+        id = (dma->dmaro->core_last + i) % SP_NR_CORES;
+        if (sp_sb_on() && !sp_cores[id]->spro->halted && sp_cores[id]->spro->sb_count &&
+            !sp_core_wants_port(sp_cores[id]))
+            order[n++] = SP_PORT_CORE + id;
+    }
+    return n;
+}
+
+// sramd port arbiter. Only depends on the old state of all the units, so the
+// cores and the DMA unit reach the same decision whichever runs first. The
+// requesters get their banks in priority order as long as nobody before them
+// took one of them; with a single bank the first one wins. Returns whether
+// who (SP_PORT_DMA or SP_PORT_CORE + id) is granted, and in *grants how many
+// requesters are.
+static int sp_port_arbitrate(dma_t* dma, int who, int* grants)
+{
+    int order[2 * SP_NR_CORES + 1];
+    int i, n, won = 0;
+    unsigned busy = 0, banks;
+
+    n = sp_port_requests(dma, order);
+    *grants = 0;
+    for (i = 0; i < n; i++) {
+        banks = sp_port_banks(dma, order[i]);
+        if (banks & busy)
+            continue;
+        busy |= banks;
+        (*grants)++;
+        if (order[i] == who)
+            won = 1;
+    }
+    return won;
+}
+
+static int sp_port_granted(dma_t* dma, int who)
+{
+    int grants;
+
+    return sp_port_arbitrate(dma, who, &grants);
+}
+
+// Core with a DMA command pending, the lowest id wins
+static sp_t* dma_command(void)
+{
+    int i;
+
+    for (i = 0; i < SP_NR_CORES; i++)
+        if (sp_cores[i]->spro->dma_cmd != sp_cores[i]->dma->dmaro->cmd_taken[i])
+            return sp_cores[i];
+    return NULL;
+}
+
+// The engine is running, a command is latched, or a lower numbered core
+// issues one this clock (it wins the tie)
+static int dma_busy(sp_t* sp)
+{
+    sp_registers_t* spro;
+    int i;
+
+    if (sp->dma->dmaro->state != DMA_STATE_IDLE || dma_command())
+        return 1;
+    for (i = 0; i < sp->id; i++) {
+        spro = sp_cores[i]->spro;
+        if (!spro->halted && spro->exec0_active &&
+            (spro->exec0_opcode == DMA_START || spro->exec0_opcode == DMA_DOORBELL))
+            return 1;
+    }
+    return 0;
+}
+
+// DMA_STATUS result: busy flag, or the completion flag when imm is 1
+static int dma_status(sp_t* sp, int sel)
+{
+    if (sel == 1)
+        return sp->dma->dmaro->done && !dma_command();
+    return dma_busy(sp);
+}
+
 // New tracer with operand overrides so the EXEC line shows the *actual* ALU inputs
-static void trace_instruction(uint32_t inst, uint32_t current_pc, int32_t* regs,
+static void trace_instruction(sp_t* sp, uint32_t inst, uint32_t current_pc, int32_t* regs,
     int use_exec_overrides, int32_t exec_opA, int32_t exec_opB)
 {
     uint8_t  opcode = (inst >> 25) & 0x1F;
@@ -161,19 +1097,27 @@ static void trace_instruction(uint32_t inst, uint32_t current_pc, int32_t* regs,
     case 4:  op_str = "AND"; break; case 5:  op_str = "OR";  break;
     case 6:  op_str = "XOR"; break; case 7:  op_str = "LHI"; break;
     case 8:  op_str = "LD";  break; case 9:  op_str = "ST";  break;
+    case 10: op_str = "DMA_START"; break; case 11: op_str = "DMA_STATUS"; break;
+    case 12: op_str = "DMA_DOORBELL"; break; case 13: op_str = "WFE"; break;
+    case 14: op_str = "CPUID"; break; case 15: op_str = "FAA"; break;
+    case 21: op_str = "CAS"; break;
+    case 22: op_str = "MUL"; break; case 23: op_str = "DIV"; break;
+    case 25: op_str = "MOD"; break; case 26: op_str = "SIMD"; break;
+    case 27: op_str = "LOOP"; break;
+    case 28: op_str = "LDI"; break; case 29: op_str = "STI"; break;
     case 16: op_str = "JLT"; break; case 17: op_str = "JLE"; break;
     case 18: op_str = "JEQ"; break; case 19: op_str = "JNE"; break;
     case 20: op_str = "JIN"; break; case 24: op_str = "HLT"; break;
     default: op_str = "UNK"; break;
     }
 
-    extern int nr_simulated_instructions;
-    extern FILE* inst_trace_fp;
-    fprintf(inst_trace_fp,
+    fprintf(sp->inst_trace_fp,
         "--- instruction %d (%04x) @ PC %d (%04d) -----------------------------------------------------------\n",
-        nr_simulated_instructions, nr_simulated_instructions, current_pc, current_pc);
+        sp->nr_simulated_instructions, sp->nr_simulated_instructions, current_pc, current_pc);
+    if (SP_NR_THREADS > 1)
+        fprintf(sp->inst_trace_fp, "thread = %d\n", sp->spro->exec1_thread);
 
-    fprintf(inst_trace_fp,
+    fprintf(sp->inst_trace_fp,
         "pc = %04d, inst = %08x, opcode = %d (%s), dst = %d, src0 = %d, src1 = %d, immediate = %08x\n",
         current_pc, inst, opcode, op_str, dst, src0, src1, (unsigned)imm16);
 
@@ -184,11 +1128,11 @@ static void trace_instruction(uint32_t inst, uint32_t current_pc, int32_t* regs,
         regs_for_print[1] = imm32;
     }
 
-    fprintf(inst_trace_fp,
+    fprintf(sp->inst_trace_fp,
         "r[0] = %08x r[1] = %08x r[2] = %08x r[3] = %08x \n",
         (uint32_t)regs_for_print[0], (uint32_t)regs_for_print[1],
         (uint32_t)regs_for_print[2], (uint32_t)regs_for_print[3]);
-    fprintf(inst_trace_fp,
+    fprintf(sp->inst_trace_fp,
         "r[4] = %08x r[5] = %08x r[6] = %08x r[7] = %08x \n\n",
         (uint32_t)regs_for_print[4], (uint32_t)regs_for_print[5],
         (uint32_t)regs_for_print[6], (uint32_t)regs_for_print[7]);
@@ -199,71 +1143,116 @@ static void trace_instruction(uint32_t inst, uint32_t current_pc, int32_t* regs,
 
     switch (opcode) {
     case 0: case 1: case 2: case 3: case 4: case 5: case 6:
-        fprintf(inst_trace_fp, ">>>> EXEC: R[%d] = %d %s %d <<<<\n\n", dst, opA, op_str, opB);
+    case 22: case 23: case 25:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: R[%d] = %d %s %d <<<<\n\n", dst, opA, op_str, opB);
         break;
 
     case 7:
-        fprintf(inst_trace_fp,
+        fprintf(sp->inst_trace_fp,
             ">>>> EXEC: R[%d] = (0x%04x << 16) | (R[%d] & 0xFFFF) <<<<\n\n",
             dst, (unsigned)imm16, dst);
         break;
 
+    case 26:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: R[%d] = %08x %s %08x <<<<\n\n",
+            dst, (uint32_t)opA, simd_name[imm16 & 0xF], (uint32_t)opB);
+        break;
+
+    case 27:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: LOOP %d times, PC %d to %d <<<<\n\n",
+            opA, (current_pc + 1) & 0xFFFF, imm16);
+        break;
+
     case 8: {
         int addr = regs[src1];
-        static llsim_memory_t* sramd_mem = NULL;
-        if (!sramd_mem) {
-            llsim_unit_t* u = llsim_find_unit("sp");
-            for (llsim_memory_t* m = u ? u->mems : NULL; m; m = m->next)
-                if (m->name && strcmp(m->name, "sramd") == 0) { sramd_mem = m; break; }
-        }
-        uint32_t mem_val = (uint32_t)regs[dst];
-        if (sramd_mem) mem_val = (uint32_t)llsim_mem_extract(sramd_mem, addr, 31, 0);
-        fprintf(inst_trace_fp, ">>>> EXEC: R[%d] = MEM[%d] = %08x <<<<\n\n", dst, addr, mem_val);
+        uint32_t mem_val = use_exec_overrides ? (uint32_t)exec_opB :
+            (uint32_t)llsim_mem_extract(sp->sramd, addr, 31, 0);
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: R[%d] = MEM[%d] = %08x <<<<\n\n", dst, addr, mem_val);
         break;
     }
 
     case 9:
-        fprintf(inst_trace_fp, ">>>> EXEC: MEM[%d] = R[%d] = %08x <<<<\n\n",
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: MEM[%d] = R[%d] = %08x <<<<\n\n",
             regs[src1], src0, (uint32_t)regs[src0]);
         break;
 
+    case 28:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: R[%d] = MEM[%d] = %08x, R[%d] += %d <<<<\n\n",
+            dst, opA, (uint32_t)opB, src1, imm32);
+        break;
+
+    case 29:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: MEM[%d] = R[%d] = %08x, R[%d] += %d <<<<\n\n",
+            opA, src0, (uint32_t)opB, src1, imm32);
+        break;
+
+    case 10:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: DMA_START MEM[%d] -> MEM[%d], %d words <<<<\n\n", opA, opB, imm32);
+        break;
+
+    case 11:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: R[%d] = DMA_STATUS = %d <<<<\n\n", dst, opA);
+        break;
+
+    case 12:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: DMA_DOORBELL descriptor MEM[%d] <<<<\n\n", opA);
+        break;
+
+    case 13:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: WFE <<<<\n\n");
+        break;
+
+    case 14:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: R[%d] = CPUID = %d <<<<\n\n", dst, opA);
+        break;
+
+    case 15:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: R[%d] = MEM[%d] = %08x, MEM[%d] += %d <<<<\n\n",
+            dst, regs[src1], (uint32_t)opB, regs[src1], opA);
+        break;
+
+    case 21:
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: R[%d] = MEM[%d] = %08x, MEM[%d] = %d if it was %d <<<<\n\n",
+            dst, regs[src1], (uint32_t)opB, regs[src1], opA, regs[dst]);
+        break;
+
     case 16: {
         int taken = (regs[src0] < regs[src1]);
         int nextpc = taken ? (int)(uint16_t)imm16 : ((current_pc + 1) & 0xFFFF);
-        fprintf(inst_trace_fp, ">>>> EXEC: JLT %d, %d, %d <<<<\n\n", regs[src0], regs[src1], nextpc); break;
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: JLT %d, %d, %d <<<<\n\n", regs[src0], regs[src1], nextpc); break;
     }
     case 17: {
         int taken = (regs[src0] <= regs[src1]);
         int nextpc = taken ? (int)(uint16_t)imm16 : ((current_pc + 1) & 0xFFFF);
-        fprintf(inst_trace_fp, ">>>> EXEC: JLE %d, %d, %d <<<<\n\n", regs[src0], regs[src1], nextpc); break;
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: JLE %d, %d, %d <<<<\n\n", regs[src0], regs[src1], nextpc); break;
     }
     case 18: {
         int taken = (regs[src0] == regs[src1]);
         int nextpc = taken ? (int)(uint16_t)imm16 : ((current_pc + 1) & 0xFFFF);
-        fprintf(inst_trace_fp, ">>>> EXEC: JEQ %d, %d, %d <<<<\n\n", regs[src0], regs[src1], nextpc); break;
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: JEQ %d, %d, %d <<<<\n\n", regs[src0], regs[src1], nextpc); break;
     }
     case 19: {
         int taken = (regs[src0] != regs[src1]);
         int nextpc = taken ? (int)(uint16_t)imm16 : ((current_pc + 1) & 0xFFFF);
-        fprintf(inst_trace_fp, ">>>> EXEC: JNE %d, %d, %d <<<<\n\n", regs[src0], regs[src1], nextpc); break;
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: JNE %d, %d, %d <<<<\n\n", regs[src0], regs[src1], nextpc); break;
     }
     case 20: {
         int nextpc = regs[dst];
-        fprintf(inst_trace_fp, ">>>> EXEC: JIN %d, %d, %d <<<<\n\n", regs[src0], regs[src1], nextpc); break;
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: JIN %d, %d, %d <<<<\n\n", regs[src0], regs[src1], nextpc); break;
     }
 
     case 24:
-        fprintf(inst_trace_fp, ">>>> EXEC: HALT at PC %04x<<<<\n", current_pc);
-        fprintf(inst_trace_fp, "sim finished at pc %d, %d instructions", current_pc, ++nr_simulated_instructions);
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: HALT at PC %04x<<<<\n", current_pc);
+        fprintf(sp->inst_trace_fp, "sim finished at pc %d, %d instructions", current_pc, ++sp->nr_simulated_instructions);
         break;
 
     default:
-        fprintf(inst_trace_fp, ">>>> EXEC: (unknown) <<<<\n\n");
+        fprintf(sp->inst_trace_fp, ">>>> EXEC: (unknown) <<<<\n\n");
         break;
     }
 
 
-    nr_simulated_instructions++;
+    sp->nr_simulated_instructions++;
 }
 
 
@@ -286,6 +1275,142 @@ static void dump_sram(sp_t* sp, char* name, llsim_memory_t* sram)
     fclose(fp);
 }
 
+static void dump_stats(sp_t* sp, char* name)
+{
+    FILE* fp;
+    sp_t* core;
+    int cycles = 0, instructions = 0, i, t;
+    i64 core_cycles = 0, idle_cycles = 0, exec0_stall_cycles = 0;
+    i64 mdu_ops = 0, mdu_dep_stall_cycles = 0, mdu_busy_stall_cycles = 0;
+    i64 loop_back_edges = 0, fused_const = 0, fused_branch = 0;
+    i64 dec0_redirects = 0, exec0_flushes = 0;
+    i64 lb_captures = 0, lb_hits = 0, lb_misses = 0, lb_streamed = 0, lb_refill_bubbles = 0;
+    i64 lvp_loads = 0, lvp_predicted = 0, lvp_correct = 0, lvp_used = 0, lvp_replays = 0;
+    i64 sb_stores = 0, sb_combined = 0, sb_forwarded = 0, sb_drains = 0, sb_full_cycles = 0;
+    i64 sb_fence_cycles = 0, sb_occupancy = 0, sb_max_occupancy = 0, port_cycles = 0;
+    i64 mm_accesses = 0, mm_cycles = 0, bank_conflict_cycles = 0, bank_shared_cycles = 0;
+
+    fp = fopen(name, "w");
+    if (fp == NULL) {
+        printf("couldn't open file %s\n", name);
+        exit(1);
+    }
+    for (i = 0; i < SP_NR_CORES; i++) {
+        core = sp_cores[i];
+        if (core->halt_cycle > cycles)
+            cycles = core->halt_cycle;
+        instructions += core->nr_simulated_instructions;
+        core_cycles += core->halt_cycle;
+        idle_cycles += core->idle_cycles;
+        exec0_stall_cycles += core->exec0_stall_cycles;
+    }
+    fprintf(fp, "cycles %d\n", cycles);
+    fprintf(fp, "instructions %d\n", instructions);
+    fprintf(fp, "ipc %.3f\n", cycles ? (double)instructions / cycles : 0.0);
+    fprintf(fp, "busy_cycles %lld idle_cycles %lld\n",
+        core_cycles - idle_cycles, idle_cycles);
+    fprintf(fp, "exec0_stall_cycles %lld\n", exec0_stall_cycles);
+    fprintf(fp, "cores %d xbar_latency %d\n", SP_NR_CORES, SP_XBAR_LATENCY);
+    for (i = 0; SP_NR_CORES > 1 && i < SP_NR_CORES; i++) {
+        core = sp_cores[i];
+        fprintf(fp, "core %d cycles %d instructions %d idle_cycles %lld xbar_cycles %lld port_lost_cycles %lld\n",
+            i, core->halt_cycle, core->nr_simulated_instructions, core->idle_cycles,
+            core->xbar_cycles, core->port_lost_cycles);
+    }
+    fprintf(fp, "threads %d mt_policy %d\n", SP_NR_THREADS, SP_MT_POLICY);
+    for (i = 0; SP_NR_THREADS > 1 && i < SP_NR_CORES; i++) {
+        core = sp_cores[i];
+        for (t = 0; t < SP_NR_THREADS; t++)
+            fprintf(fp, "core %d thread %d cycles %d instructions %d ipc %.3f\n", i, t,
+                core->thread_halt_cycle[t], core->thread_instructions[t],
+                core->halt_cycle ? (double)core->thread_instructions[t] / core->halt_cycle : 0.0);
+        fprintf(fp, "core %d ipc %.3f\n", i,
+            core->halt_cycle ? (double)core->nr_simulated_instructions / core->halt_cycle : 0.0);
+    }
+    for (i = 0; SP_DCACHE && i < SP_NR_CORES; i++)
+        fprintf(fp, "core %d dcache_stall_cycles %lld coherence_stall_cycles %lld\n",
+            i, sp_cores[i]->dcache_stall_cycles, sp_cores[i]->coherence_stall_cycles);
+    for (i = 0; i < SP_NR_CORES; i++) {
+        mdu_ops += sp_cores[i]->mdu_ops;
+        mdu_dep_stall_cycles += sp_cores[i]->mdu_dep_stall_cycles;
+        mdu_busy_stall_cycles += sp_cores[i]->mdu_busy_stall_cycles;
+    }
+    fprintf(fp, "mdu mul_latency %d div_latency %d ops %lld dep_stall_cycles %lld busy_stall_cycles %lld\n",
+        SP_MUL_LATENCY, SP_DIV_LATENCY, mdu_ops, mdu_dep_stall_cycles, mdu_busy_stall_cycles);
+    for (i = 0; i < SP_NR_CORES; i++) {
+        loop_back_edges += sp_cores[i]->loop_back_edges;
+        fused_const += sp_cores[i]->fused_const;
+        fused_branch += sp_cores[i]->fused_branch;
+        dec0_redirects += sp_cores[i]->dec0_redirects;
+        exec0_flushes += sp_cores[i]->exec0_flushes;
+        lb_captures += sp_cores[i]->lb_captures;
+        lb_hits += sp_cores[i]->lb_hits;
+        lb_misses += sp_cores[i]->lb_misses;
+        lb_streamed += sp_cores[i]->lb_streamed;
+        lb_refill_bubbles += sp_cores[i]->lb_refill_bubbles;
+        lvp_loads += sp_cores[i]->lvp_loads;
+        lvp_predicted += sp_cores[i]->lvp_predicted;
+        lvp_correct += sp_cores[i]->lvp_correct;
+        lvp_used += sp_cores[i]->lvp_used;
+        lvp_replays += sp_cores[i]->lvp_replays;
+        sb_stores += sp_cores[i]->sb_stores;
+        sb_combined += sp_cores[i]->sb_combined;
+        sb_forwarded += sp_cores[i]->sb_forwarded;
+        sb_drains += sp_cores[i]->sb_drains;
+        sb_full_cycles += sp_cores[i]->sb_full_cycles;
+        sb_fence_cycles += sp_cores[i]->sb_fence_cycles;
+        sb_occupancy += sp_cores[i]->sb_occupancy;
+        if (sp_cores[i]->sb_max_occupancy > sb_max_occupancy)
+            sb_max_occupancy = sp_cores[i]->sb_max_occupancy;
+        port_cycles += sp_cores[i]->port_cycles;
+        mm_accesses += sp_cores[i]->mm_accesses;
+        mm_cycles += sp_cores[i]->mm_cycles;
+        bank_conflict_cycles += sp_cores[i]->bank_conflict_cycles;
+        bank_shared_cycles += sp_cores[i]->bank_shared_cycles;
+    }
+    fprintf(fp, "loop back_edges %lld\n", loop_back_edges);
+    fprintf(fp, "fusion const_pairs %lld branch_pairs %lld fused_instructions %.3f\n", fused_const, fused_branch,
+        instructions ? 2.0 * (fused_const + fused_branch) / instructions : 0.0);
+    fprintf(fp, "branch dec0_redirects %lld exec0_flushes %lld\n", dec0_redirects, exec0_flushes);
+    // a hit skips FETCH0, FETCH1 and DEC0
+    fprintf(fp, "loop_buffer words %d captures %lld hits %lld misses %lld hit_rate %.3f streamed %lld refill_bubbles %lld cycles_saved %lld\n",
+        SP_LOOP_BUFFER ? SP_LOOP_BUFFER_WORDS : 0, lb_captures, lb_hits, lb_misses,
+        lb_hits + lb_misses ? (double)lb_hits / (lb_hits + lb_misses) : 0.0, lb_streamed, lb_refill_bubbles,
+        3 * lb_hits - lb_refill_bubbles);
+    // a good prediction saves the load-use stall, a replay refetches four
+    // stages behind where the stall would have let the dependent go
+    fprintf(fp, "lvp entries %d loads %lld coverage %.3f accuracy %.3f used %lld replays %lld net_cycles_saved %lld\n",
+        SP_LVP ? SP_LVP_ENTRIES : 0, lvp_loads, lvp_loads ? (double)lvp_predicted / lvp_loads : 0.0,
+        lvp_predicted ? (double)lvp_correct / lvp_predicted : 0.0, lvp_used, lvp_replays,
+        lvp_used - lvp_replays - 4 * lvp_replays);
+    fprintf(fp, "store_buffer entries %d line_words %d stores %lld combined %lld forwarded %lld drains %lld full_cycles %lld fence_cycles %lld avg_occupancy %.3f max_occupancy %lld\n",
+        sp_sb_on() ? SP_STORE_BUFFER_ENTRIES : 0, SP_STORE_BUFFER_LINE_WORDS, sb_stores, sb_combined, sb_forwarded,
+        sb_drains, sb_full_cycles, sb_fence_cycles, core_cycles ? (double)sb_occupancy / core_cycles : 0.0,
+        sb_max_occupancy);
+    // one word per cycle, a store buffer drain writes a whole line
+    fprintf(fp, "port cycles %d core %lld drain %lld dma %lld utilization %.3f\n", cycles, port_cycles, sb_drains,
+        sp->dma->port_cycles, cycles ? (double)(port_cycles + sb_drains + sp->dma->port_cycles) / cycles : 0.0);
+    // a conflict cycle lost the bank it wanted, a shared cycle had the port
+    // while another requester used a different bank
+    fprintf(fp, "sramd banks %d core_conflict_cycles %lld dma_conflict_cycles %lld shared_cycles core %lld dma %lld\n",
+        SP_SRAMD_BANKS, bank_conflict_cycles, sp_banked() ? sp->dma->stalled_cycles : 0, bank_shared_cycles,
+        sp->dma->bank_shared_cycles);
+    fprintf(fp, "dma burst_words %d arb_policy %d\n", SP_DMA_BURST_WORDS, SP_DMA_ARB_POLICY);
+    fprintf(fp, "dma words %lld descriptors %lld busy_cycles %lld stolen_cycles %lld stalled_cycles %lld\n",
+        sp->dma->words, sp->dma->descriptors, sp->dma->busy_cycles, sp->dma->stolen_cycles, sp->dma->stalled_cycles);
+    fprintf(fp, "main_mem scratch_words %d latency %d core_accesses %lld core_wait_cycles %lld dma_wait_cycles %lld\n",
+        SP_MAIN_MEM ? SP_SCRATCH_WORDS : 0x10000, SP_MAIN_MEM ? SP_MAIN_MEM_LATENCY : 0, mm_accesses, mm_cycles,
+        sp->dma->mm_cycles);
+    for (i = 0; i < SP_AMO_STATS; i++)
+        if (sp_amo_stats[i].ops || sp_amo_stats[i].wait_cycles)
+            fprintf(fp, "amo addr %d ops %lld cas_fails %lld wait_cycles %lld\n", sp_amo_stats[i].addr,
+                sp_amo_stats[i].ops, sp_amo_stats[i].cas_fails, sp_amo_stats[i].wait_cycles);
+    llsim_prefetch_dump(fp, sp->srami);
+    llsim_prefetch_dump(fp, sp->sramd);
+    llsim_coherence_dump(fp, sp->sramd);
+    fclose(fp);
+}
+
 static void sp_reset(sp_t* sp)
 {
     printf("%s\n", SP_BUILD_TAG);
@@ -296,9 +1421,125 @@ static void sp_reset(sp_t* sp)
     sprn->fetch0_active = 0;
 }
 
+// Forward a value written to register "reg" (0: none) to the DEC1 operands
+static void sp_forward(sp_t* sp, int reg, int value)
+{
+    sp_registers_t* s = sp->spro;
+
+    if (reg < 2)
+        return;
+    if (reg == s->dec1_src0) {
+        sp->forward_alu0 = 1;
+        sp->forward_value_alu0 = value;
+    }
+    if (reg == s->dec1_src1) {
+        sp->forward_alu1 = 1;
+        sp->forward_value_alu1 = value;
+    }
+    if (s->dec1_opcode == CAS && reg == s->dec1_dst) {
+        sp->forward_alu2 = 1;
+        sp->forward_value_alu2 = value;
+    }
+}
+
+// Value the load in EXEC1 has read
+static int sp_load_value(sp_t* sp)
+{
+    return (sp_direct_sramd() || sp_banked() || sp->spro->exec1_sb_fwd) ? sp->spro->exec1_aluout :
+        llsim_mem_extract_dataout(sp->sramd, 31, 0);
+}
+
+// Write the oldest line of the store buffer to sramd
+static void sp_sb_drain(sp_t* sp)
+{
+    sp_registers_t* sprn = sp->sprn;
+    int e = sprn->sb_head, i;
+
+    for (i = 0; i < SP_STORE_BUFFER_LINE_WORDS; i++)
+        if ((sprn->sb[e].mask >> i) & 1)
+            llsim_mem_inject(sp->sramd, (sprn->sb[e].line * SP_STORE_BUFFER_LINE_WORDS + i) & 0xFFFF,
+                sprn->sb[e].data[i], 31, 0);
+    sprn->sb_head = (e + 1) % SP_STORE_BUFFER_ENTRIES;
+    sprn->sb_count--;
+    sprn->sb_age = 0;
+    sp->sb_drains++;
+}
+
+// Put a store into the store buffer, combined with the tail line if it is
+// the store's
+static void sp_sb_put(sp_t* sp, int addr, int value)
+{
+    sp_registers_t* sprn = sp->sprn;
+    int w = addr % SP_STORE_BUFFER_LINE_WORDS;
+    int e = (sprn->sb_head + sprn->sb_count - 1 + SP_STORE_BUFFER_ENTRIES) % SP_STORE_BUFFER_ENTRIES;
+
+    sp->sb_stores++;
+    if (sprn->sb_count && sprn->sb[e].line == addr / SP_STORE_BUFFER_LINE_WORDS) {
+        sp->sb_combined++;
+    }
+    else {
+        e = (sprn->sb_head + sprn->sb_count) % SP_STORE_BUFFER_ENTRIES;
+        sprn->sb_count++;
+        sprn->sb[e].line = addr / SP_STORE_BUFFER_LINE_WORDS;
+        sprn->sb[e].mask = 0;
+    }
+    sprn->sb[e].data[w] = value;
+    sprn->sb[e].mask |= 1 << w;
+}
+
+// Value the load in EXEC0 is predicted to read, returns 0 if there is no
+// confident prediction
+static int sp_lvp_predict(sp_t* sp, int* value)
+{
+    sp_registers_t* s = sp->spro;
+    int i = s->exec0_pc % SP_LVP_ENTRIES, last = s->lvp[i].last;
+
+    if (s->lvp[i].tag != s->exec0_pc || s->lvp[i].conf < SP_LVP_CONFIDENT)
+        return 0;
+    // the previous run of the same load is in EXEC1, not trained in yet
+    if (s->exec1_active && s->exec1_pc == s->exec0_pc && sp_is_load(s->exec1_opcode))
+        last = sp_load_value(sp);
+    *value = last + s->lvp[i].stride;
+    return 1;
+}
+
+// Train the predictor with the value the EXEC1 load has read
+static void sp_lvp_train(sp_t* sp, int value)
+{
+    sp_registers_t* spro = sp->spro;
+    sp_registers_t* sprn = sp->sprn;
+    int i = spro->exec1_pc % SP_LVP_ENTRIES, stride;
+
+    sp->lvp_loads++;
+    if (spro->lvp[i].tag != spro->exec1_pc) {
+        sprn->lvp[i].tag = spro->exec1_pc;
+        sprn->lvp[i].last = value;
+        sprn->lvp[i].stride = 0;
+        sprn->lvp[i].conf = 0;
+        return;
+    }
+    if (spro->lvp[i].conf >= SP_LVP_CONFIDENT) {
+        sp->lvp_predicted++;
+        if (spro->lvp[i].last + spro->lvp[i].stride == value)
+            sp->lvp_correct++;
+    }
+    stride = value - spro->lvp[i].last;
+    if (stride == spro->lvp[i].stride)
+        sprn->lvp[i].conf = (spro->lvp[i].conf < 3) ? spro->lvp[i].conf + 1 : 3;
+    else
+        sprn->lvp[i].conf = 0;
+    sprn->lvp[i].last = value;
+    sprn->lvp[i].stride = stride;
+}
+
 static void detect_hazards(sp_t* sp)
 {
     sp_registers_t* s = sp->spro;
+    // an EXEC0 instruction of a thread halting this clock is dropped, so is
+    // one replayed for a wrong load value or a WFE going to sleep
+    int ex0_active = s->exec0_active && !sp->sprn->thread_halted[s->exec0_thread] && !sp->lvp_replay &&
+        !sp->wfe_park;
+    int value;
 
     // Reset all hazard/forwarding signals for this cycle
     sp->stall = 0;
@@ -306,20 +1547,27 @@ static void detect_hazards(sp_t* sp)
 
     sp->forward_alu0 = 0;
     sp->forward_alu1 = 0;
+    sp->forward_alu2 = 0;
     sp->forward_value_alu0 = 0;
     sp->forward_value_alu1 = 0;
+    sp->forward_value_alu2 = 0;
+    sp->lvp_forward = 0;
 
     // --------------------------
     // Data hazards (DEC1 consumers vs. EXEC0/EXEC1 producers)
     // --------------------------
     if (s->dec1_active) {
 
-        // ---------- Forward from EXEC1 (ALU + LD) — PRIORITY #1 ----------
+        // ---------- Forward from EXEC1 (ALU + LD) ----------
         // For LD, the value is available on the dataout port *this* cycle.
-        if (s->exec1_active && s->exec1_dst >= 2) {
-            int fwd1 = (s->exec1_opcode == LD)
-                ? llsim_mem_extract_dataout(sp->sramd, 31, 0)
-                : s->exec1_aluout;
+        // (a MUL/DIV/MOD in EXEC1 hasn't produced its result yet)
+        // The next address of LDI/STI goes first, the loaded value overrides it.
+        if (s->exec1_active && s->exec1_thread == s->dec1_thread)
+            sp_forward(sp, sp_inc_reg(s->exec1_opcode, s->exec1_src1), s->exec1_alu1 + s->exec1_immediate);
+
+        if (s->exec1_active && s->exec1_thread == s->dec1_thread && s->exec1_dst >= 2 &&
+            !sp_is_mdu(s->exec1_opcode) && !sp_is_store(s->exec1_opcode)) {
+            int fwd1 = sp_is_load(s->exec1_opcode) ? sp_load_value(sp) : s->exec1_aluout;
 
             if (s->exec1_dst == s->dec1_src0) {
                 sp->forward_alu0 = 1;
@@ -329,14 +1577,19 @@ static void detect_hazards(sp_t* sp)
                 sp->forward_alu1 = 1;
                 sp->forward_value_alu1 = fwd1;
             }
+            if (s->dec1_opcode == CAS && s->exec1_dst == s->dec1_dst) {
+                sp->forward_alu2 = 1;
+                sp->forward_value_alu2 = fwd1;
+            }
         }
 
-        // ---------- Forward from EXEC0 (ALU-only) — PRIORITY #2 / fallback ----------
+        // ---------- Forward from EXEC0 (ALU-only) ----------
         // Recompute the ALU result here (exec0_aluout of the *old* state is not final yet).
+        // EXEC0 holds the younger producer, so it overrides EXEC1.
         int ex0_can_fw = 0;
         int ex0_res = 0;
 
-        if (s->exec0_active && s->exec0_dst >= 2) {
+        if (ex0_active && s->exec0_thread == s->dec1_thread && s->exec0_dst >= 2) {
             switch (s->exec0_opcode) {
             case ADD: ex0_can_fw = 1; ex0_res = s->exec0_alu0 + s->exec0_alu1; break;
             case SUB: ex0_can_fw = 1; ex0_res = s->exec0_alu0 - s->exec0_alu1; break;
@@ -350,143 +1603,509 @@ static void detect_hazards(sp_t* sp)
                 ex0_res = (((uint32_t)s->exec0_immediate & 0xFFFF) << 16) |
                     (s->exec0_alu0 & 0xFFFF);
                 break;
+            case DMA_STATUS: ex0_can_fw = 1; ex0_res = dma_status(sp, s->exec0_immediate); break;
+            case CPUID: ex0_can_fw = 1; ex0_res = sp_cpuid(sp, s->exec0_immediate, s->exec0_thread); break;
+            case SIMD: ex0_can_fw = 1; ex0_res = sp_simd_result(s->exec0_immediate, s->exec0_alu0, s->exec0_alu1); break;
             default:
                 // No EXEC0 forwarding for LD/ST/branches
                 break;
             }
+            if (ex0_can_fw)
+                ex0_res = sp_fused_result(s->exec0_fused, s->exec0_inst2, s->exec0_dst, ex0_res);
         }
 
         if (ex0_can_fw) {
-            if (!sp->forward_alu0 && s->exec0_dst == s->dec1_src0) {
+            if (s->exec0_dst == s->dec1_src0) {
                 sp->forward_alu0 = 1;
                 sp->forward_value_alu0 = ex0_res;
             }
-            if (!sp->forward_alu1 && s->exec0_dst == s->dec1_src1) {
+            if (s->exec0_dst == s->dec1_src1) {
                 sp->forward_alu1 = 1;
                 sp->forward_value_alu1 = ex0_res;
             }
+            if (s->dec1_opcode == CAS && s->exec0_dst == s->dec1_dst) {
+                sp->forward_alu2 = 1;
+                sp->forward_value_alu2 = ex0_res;
+            }
+        }
+
+        // The next address of LDI/STI is known in EXEC0
+        if (ex0_active && s->exec0_thread == s->dec1_thread)
+            sp_forward(sp, sp_inc_reg(s->exec0_opcode, s->exec0_src1), s->exec0_alu1 + s->exec0_immediate);
+
+        // ---------- Load-use stall (producer LD still in EXEC0) ----------
+        // When LD is in EXEC0, its data is NOT ready this cycle -> must stall the consumer.
+        // Same for the old value returned by an atomic.
+        // (or the consumer goes on with the predicted value of a LD)
+        if (ex0_active && s->exec0_thread == s->dec1_thread && s->exec0_dst >= 2 &&
+            (sp_is_load(s->exec0_opcode) || s->exec0_opcode == FAA || s->exec0_opcode == CAS)) {
+            if (s->exec0_dst == s->dec1_src0 || s->exec0_dst == s->dec1_src1 ||
+                (s->dec1_opcode == CAS && s->exec0_dst == s->dec1_dst)) {
+                if (SP_LVP && sp_is_load(s->exec0_opcode) && sp_lvp_predict(sp, &value)) {
+                    sp_forward(sp, s->exec0_dst, value);
+                    sp->lvp_forward = 1;
+                    sp->lvp_value = value;
+                }
+                else {
+                    sp->stall = 1;
+                }
+            }
+        }
+
+        // ---------- Multiply/divide unit ----------
+        // Readers and writers of the register the unit owes wait for it, the
+        // result is forwarded in the clock it is written back. Taken branches
+        // write r7.
+        int md_dst = 0, md_wait = 0;
+        if (ex0_active && s->exec0_thread == s->dec1_thread && sp_is_mdu(s->exec0_opcode)) {
+            md_dst = s->exec0_dst;
+            md_wait = 1;
+        }
+        else if (s->mdu_busy && s->mdu_thread == s->dec1_thread) {
+            md_dst = s->mdu_dst;
+            md_wait = s->mdu_busy > 1;
+        }
+        if (md_dst >= 2) {
+            int use0 = (md_dst == s->dec1_src0);
+            int use1 = (md_dst == s->dec1_src1);
+            int use2 = (s->dec1_opcode == CAS && md_dst == s->dec1_dst);
+
+            if (md_wait && (use0 || use1 || use2 || md_dst == s->dec1_dst ||
+                (md_dst == 7 && ((s->dec1_opcode >= JLT && s->dec1_opcode <= JIN) ||
+                s->dec1_fused == SP_FUSE_BRANCH)))) {
+                sp->stall = 1;
+                sp->mdu_dep_stall_cycles++;
+            }
+            else if (!md_wait) {
+                if (use0) {
+                    sp->forward_alu0 = 1;
+                    sp->forward_value_alu0 = s->mdu_value;
+                }
+                if (use1) {
+                    sp->forward_alu1 = 1;
+                    sp->forward_value_alu1 = s->mdu_value;
+                }
+                if (use2) {
+                    sp->forward_alu2 = 1;
+                    sp->forward_value_alu2 = s->mdu_value;
+                }
+            }
+        }
+
+        // one operation at a time
+        if (sp_is_mdu(s->dec1_opcode) &&
+            ((ex0_active && sp_is_mdu(s->exec0_opcode)) || s->mdu_busy > 1)) {
+            sp->stall = 1;
+            sp->mdu_busy_stall_cycles++;
+        }
+    }
+
+    // EXEC0 holding its instruction backs up everything behind it
+    if (sp->exec0_stall)
+        sp->stall = 1;
+
+    // --------------------------
+    // Control hazards (branch resolved in EXEC0)
+    // --------------------------
+    sp->branch_taken = 0;
+    sp->branch_target = 0;
+    sp->dec0_redirect = 0;
+    sp->lb_hit = 0;
+
+    // (a jump DEC0 has taken goes on only to write r7)
+    if (ex0_active && !s->exec0_redirected) {
+        switch (s->exec0_opcode) {
+        case JLT:
+            if (s->exec0_alu0 < s->exec0_alu1) {
+                sp->branch_taken = 1;
+                sp->branch_target = s->exec0_immediate & 0xFFFF;
+            }
+            break;
+        case JLE:
+            if (s->exec0_alu0 <= s->exec0_alu1) {
+                sp->branch_taken = 1;
+                sp->branch_target = s->exec0_immediate & 0xFFFF;
+            }
+            break;
+        case JEQ:
+            if (s->exec0_alu0 == s->exec0_alu1) {
+                sp->branch_taken = 1;
+                sp->branch_target = s->exec0_immediate & 0xFFFF;
+            }
+            break;
+        case JNE:
+            if (s->exec0_alu0 != s->exec0_alu1) {
+                sp->branch_taken = 1;
+                sp->branch_target = s->exec0_immediate & 0xFFFF;
+            }
+            break;
+        case JIN:
+            sp->branch_taken = 1;
+            sp->branch_target = s->exec0_alu0;  // jump to value in R[dst]
+            break;
+        case LOOP:
+            // refetch the body with the loop armed, or skip it
+            sp->branch_taken = 1;
+            sp->branch_target = (s->exec0_alu0 > 0) ? (s->exec0_pc + 1) & 0xFFFF :
+                (s->exec0_immediate + 1) & 0xFFFF;
+            break;
+        default:
+            break;
+        }
+
+        // the branch of an ALU + branch pair, on the ALU result
+        if (s->exec0_fused == SP_FUSE_BRANCH &&
+            sp_fused_taken(s->exec0_inst2, s->exec0_dst,
+                sp_alu_result(s->exec0_opcode, s->exec0_alu0, s->exec0_alu1, s->exec0_immediate))) {
+            sp->branch_taken = 1;
+            sp->branch_target = s->exec0_inst2 & 0xFFFF;
         }
 
-        // ---------- Load-use stall (producer LD still in EXEC0) ----------
-        // When LD is in EXEC0, its data is NOT ready this cycle -> must stall the consumer.
-        if (s->exec0_active && s->exec0_opcode == LD && s->exec0_dst >= 2) {
-            if (s->exec0_dst == s->dec1_src0 || s->exec0_dst == s->dec1_src1)
-                sp->stall = 1;
-        }
+        if (sp->branch_taken) {
+            sp->flush = 1;
+            sp->exec0_flushes++;
+        }
+    }
+
+    // an instruction that took a wrong load value is fetched again, so is a
+    // WFE once its thread wakes up
+    if (sp->lvp_replay || sp->wfe_park) {
+        sp->branch_taken = 1;
+        sp->branch_target = s->exec0_pc;
+        sp->flush = 1;
+    }
+
+    // nothing to wait for when the stalled instruction is flushed
+    if (sp->flush && s->dec1_thread == s->exec0_thread && !sp->exec0_stall)
+        sp->stall = 0;
+}
+
+
+
+
+// The younger instructions of a thread are dropped when its branch is taken
+// in EXEC0 or once it has halted
+static int sp_squashed(sp_t* sp, int thread)
+{
+    return (sp->flush && sp->spro->exec0_thread == thread) || sp->sprn->thread_halted[thread];
+}
+
+// FETCH0 holds the end of the thread's hardware loop and goes back to its start
+static int sp_loop_back(sp_t* sp, int thread)
+{
+    sp_registers_t* spro = sp->spro;
+
+    return !(sp->branch_taken && spro->exec0_thread == thread) &&
+        spro->fetch0_active && spro->fetch0_thread == thread &&
+        spro->fetch0_pc == spro->lp_end[thread] && spro->lp_fetch[thread] > 0;
+}
+
+// The loop buffer holds every instruction DEC1 takes from pc to the end of
+// its loop
+static int sp_lb_holds(sp_registers_t* spro, int pc)
+{
+    if (!spro->lb_loaded || pc < spro->lb_start || pc > spro->lb_end)
+        return 0;
+    while (pc <= spro->lb_end) {
+        if (!spro->lb[pc - spro->lb_start].valid)
+            return 0;
+        pc += (spro->lb[pc - spro->lb_start].fused != SP_FUSE_NONE) ? 2 : 1;
+    }
+    return pc == spro->lb_end + 1;
+}
+
+// A taken branch into the loop buffer streams from it, a short backward one
+// it misses allocates the buffer to its loop
+static void sp_lb_lookup(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+    sp_registers_t* sprn = sp->sprn;
+    int i, end;
+
+    if (SP_NR_THREADS > 1 || !sp->branch_taken || sp->lvp_replay || spro->exec0_opcode == LOOP ||
+        spro->lp_fetch[0] || spro->lp_exec[0])
+        return;
+    if (sp_lb_holds(spro, sp->branch_target)) {
+        sp->lb_hit = 1;
+        sp->lb_hits++;
+        return;
+    }
+    sp->lb_misses++;
+
+    end = spro->exec0_pc + (spro->exec0_fused == SP_FUSE_BRANCH);
+    if (spro->exec0_opcode == JIN || sp->branch_target > end ||
+        end - sp->branch_target >= SP_LOOP_BUFFER_WORDS ||
+        (spro->lb_loaded && spro->lb_start == sp->branch_target && spro->lb_end == end))
+        return;
+    sprn->lb_loaded = 1;
+    sprn->lb_start = sp->branch_target;
+    sprn->lb_end = end;
+    for (i = 0; i < SP_LOOP_BUFFER_WORDS; i++)
+        sprn->lb[i].valid = 0;
+    sp->lb_captures++;
+}
+
+// The instruction DEC1 passes to EXEC0 is kept if it belongs to the loop,
+// a LOOP inside it gives the loop up
+static void sp_lb_capture(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+    sp_registers_t* sprn = sp->sprn;
+    int i = spro->dec1_pc - spro->lb_start;
+
+    if (!spro->lb_loaded || spro->dec1_pc < spro->lb_start || spro->dec1_pc > spro->lb_end)
+        return;
+    if (spro->dec1_opcode == LOOP) {
+        sprn->lb_loaded = 0;
+        return;
+    }
+    sprn->lb[i].valid = 1;
+    sprn->lb[i].inst = spro->dec1_inst;
+    sprn->lb[i].opcode = spro->dec1_opcode;
+    sprn->lb[i].src0 = spro->dec1_src0;
+    sprn->lb[i].src1 = spro->dec1_src1;
+    sprn->lb[i].dst = spro->dec1_dst;
+    sprn->lb[i].immediate = spro->dec1_immediate;
+    sprn->lb[i].fused = spro->dec1_fused;
+    sprn->lb[i].inst2 = spro->dec1_inst2;
+}
+
+// DEC1 takes the next instruction of the loop from the buffer, the stream
+// ends with the last one
+static void sp_lb_stream(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+    sp_registers_t* sprn = sp->sprn;
+    int pc = sp->lb_hit ? sp->branch_target : spro->lb_pc;
+    int i = pc - spro->lb_start;
+
+    sprn->dec1_active = 1;
+    sprn->dec1_thread = 0;
+    sprn->dec1_pc = pc;
+    sprn->dec1_inst = spro->lb[i].inst;
+    sprn->dec1_opcode = spro->lb[i].opcode;
+    sprn->dec1_src0 = spro->lb[i].src0;
+    sprn->dec1_src1 = spro->lb[i].src1;
+    sprn->dec1_dst = spro->lb[i].dst;
+    sprn->dec1_immediate = spro->lb[i].immediate;
+    sprn->dec1_fused = spro->lb[i].fused;
+    sprn->dec1_inst2 = spro->lb[i].inst2;
+    sprn->dec1_redirected = 0;
+    sp->lb_streamed++;
+
+    pc += (spro->lb[i].fused != SP_FUSE_NONE) ? 2 : 1;
+    sprn->lb_pc = pc;
+    sprn->lb_stream = (pc <= spro->lb_end);
+    sprn->lb_refill = !sprn->lb_stream;
+}
+
+// PC a thread fetches from next: after its instruction in FETCH0, or where
+// its taken branch or hardware loop goes (after the loop when the loop
+// buffer streams the branch target)
+static int sp_thread_next_pc(sp_t* sp, int thread)
+{
+    sp_registers_t* spro = sp->spro;
+
+    if (sp->branch_taken && spro->exec0_thread == thread)
+        return sp->lb_hit ? (spro->lb_end + 1) & 0xFFFF : sp->branch_target;
+    if (sp->dec0_redirect && spro->dec0_thread == thread)
+        return sp->dec0_target;
+    if (sp_loop_back(sp, thread))
+        return spro->lp_start[thread];
+    if (spro->fetch0_active && spro->fetch0_thread == thread)
+        return spro->fetch0_pc + 1;
+    return spro->thread_pc[thread];
+}
+
+// Thread FETCH0 fetches from next, halted and sleeping threads are skipped
+static int sp_next_thread(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+    sp_registers_t* sprn = sp->sprn;
+    int i, thread = spro->fetch_thread;
+
+    if (SP_MT_POLICY == SP_MT_SWITCH_ON_STALL && !spro->mt_switch &&
+        !sp_squashed(sp, thread) && !sprn->wfe_sleep[thread])
+        return thread;
+    for (i = 1; i <= SP_NR_THREADS; i++) {
+        thread = (spro->fetch_thread + i) % SP_NR_THREADS;
+        if (!sprn->thread_halted[thread] && !sprn->wfe_sleep[thread])
+            return thread;
+    }
+    return spro->fetch_thread;
+}
+
+// An event is pending for the thread. A DMA completion reaches every thread,
+// each one consumes its own.
+static int sp_event(sp_t* sp, int thread)
+{
+    return sp->spro->event_reg[thread] || sp->spro->dma_events != sp->dma->dmaro->events;
+}
+
+// Every live thread sleeps in WFE and no event is pending for any of them
+static int sp_asleep(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+    int t, n = 0;
+
+    for (t = 0; t < SP_NR_THREADS; t++) {
+        if (spro->thread_halted[t])
+            continue;
+        if (!spro->wfe_sleep[t] || sp_event(sp, t))
+            return 0;
+        n++;
     }
+    return n > 0;
+}
 
-    // --------------------------
-    // Control hazards (branch resolved in EXEC0)
-    // --------------------------
-    sp->branch_taken = 0;
-    sp->branch_target = 0;
+// A live thread other than this one is awake to use the pipeline
+static int sp_other_awake(sp_t* sp, int thread)
+{
+    sp_registers_t* sprn = sp->sprn;
+    int t;
 
-    if (s->exec0_active) {
-        switch (s->exec0_opcode) {
-        case JLT:
-            if (s->exec0_alu0 < s->exec0_alu1) {
-                sp->branch_taken = 1;
-                sp->branch_target = s->exec0_immediate & 0xFFFF;
-            }
-            break;
-        case JLE:
-            if (s->exec0_alu0 <= s->exec0_alu1) {
-                sp->branch_taken = 1;
-                sp->branch_target = s->exec0_immediate & 0xFFFF;
-            }
-            break;
-        case JEQ:
-            if (s->exec0_alu0 == s->exec0_alu1) {
-                sp->branch_taken = 1;
-                sp->branch_target = s->exec0_immediate & 0xFFFF;
-            }
-            break;
-        case JNE:
-            if (s->exec0_alu0 != s->exec0_alu1) {
-                sp->branch_taken = 1;
-                sp->branch_target = s->exec0_immediate & 0xFFFF;
-            }
-            break;
-        case JIN:
-            sp->branch_taken = 1;
-            sp->branch_target = s->exec0_alu0;  // jump to value in R[dst]
-            break;
-        default:
+    for (t = 0; t < SP_NR_THREADS; t++)
+        if (t != thread && !sprn->thread_halted[t] && !sprn->wfe_sleep[t])
+            return 1;
+    return 0;
+}
+
+// Data cache access of the EXEC0 LD/ST: probe the tags, on a miss wait for
+// the sramd port to run the bus transaction, then wait for the fill. The
+// access completes with the fill even if another cache has taken the line
+// meanwhile, otherwise two writers could steal it from each other forever.
+// Returns 1 while EXEC0 has to hold.
+static int sp_dcache_step(sp_t* sp)
+{
+    sp_registers_t* spro = sp->spro;
+    sp_registers_t* sprn = sp->sprn;
+    int write = sp_is_store(spro->exec0_opcode);
+    int addr = spro->exec0_alu1 & 0xFFFF;
+    int kind;
+
+    switch (spro->exec0_dc_state) {
+    case SP_DC_PROBE:
+        if (llsim_cache_hit(sp->dcache, addr, write)) {
+            llsim_cache_access(sp->dcache, addr, write);
+            return 0;
+        }
+        sprn->exec0_dc_state = SP_DC_MISS;
+        break;
+
+    case SP_DC_MISS:
+        if (!sp_relaxed() && !sp_port_granted(sp->dma, SP_PORT_CORE + sp->id)) {
+            sp->port_lost_cycles++;
             break;
         }
+        kind = llsim_cache_access(sp->dcache, addr, write);
+        sprn->exec0_dc_coh = (kind == LLSIM_CACHE_COHERENCE_MISS || kind == LLSIM_CACHE_UPGRADE);
+        sprn->exec0_dc_state = SP_DC_FILL;
+        sprn->exec0_dc_fill = SP_DCACHE_MISS_LATENCY + (sp_main_mem(addr) ? SP_MAIN_MEM_LATENCY : 0);
+        if (sprn->exec0_dc_coh)
+            sp->coherence_stall_cycles++;
+        break;
 
-        if (sp->branch_taken)
-            sp->flush = 1;
+    case SP_DC_FILL:
+        if (spro->exec0_dc_coh)
+            sp->coherence_stall_cycles++;
+        if (spro->exec0_dc_fill > 1) {
+            sprn->exec0_dc_fill = spro->exec0_dc_fill - 1;
+            break;
+        }
+        sprn->exec0_dc_state = SP_DC_PROBE;
+        return 0;
     }
+    sp->dcache_stall_cycles++;
+    return 1;
 }
 
-
-
-
 static void sp_ctl(sp_t* sp)
 {
     sp_registers_t* spro = sp->spro;
     sp_registers_t* sprn = sp->sprn;
-    int i;
+    int i, t, last, ex0_active, fused = 0, lb_stream, lb_hold, mine, grants, sb_drain;
+
+    // Idle fast path: every thread is asleep in WFE with the pipeline drained
+    // behind them, so nothing but the cycle counter can change until an event
+    // arrives.
+    if (sp_asleep(sp) && !spro->exec1_active && !spro->mdu_busy) {
+        fprintf(sp->cycle_trace_fp, "cycle %d idle\n\n\n\n", spro->cycle_counter);
+        sprn->cycle_counter = spro->cycle_counter + 1;
+        sp->idle_cycles++;
+        return;
+    }
 
-    fprintf(cycle_trace_fp, "cycle %d\n", spro->cycle_counter);
-    fprintf(cycle_trace_fp, "cycle_counter %08x\n", spro->cycle_counter);
+    fprintf(sp->cycle_trace_fp, "cycle %d\n", spro->cycle_counter);
+    fprintf(sp->cycle_trace_fp, "cycle_counter %08x\n", spro->cycle_counter);
     for (i = 2; i <= 7; i++)
-        fprintf(cycle_trace_fp, "r%d %08x\n", i, spro->r[i]);
-
-    fprintf(cycle_trace_fp, "fetch0_active %08x\n", spro->fetch0_active);
-    fprintf(cycle_trace_fp, "fetch0_pc %08x\n", spro->fetch0_pc);
-
-    fprintf(cycle_trace_fp, "fetch1_active %08x\n", spro->fetch1_active);
-    fprintf(cycle_trace_fp, "fetch1_pc %08x\n", spro->fetch1_pc);
-
-
-    fprintf(cycle_trace_fp, "dec0_active %08x\n", spro->dec0_active);
-    fprintf(cycle_trace_fp, "dec0_pc %08x\n", spro->dec0_pc);
-    fprintf(cycle_trace_fp, "dec0_inst %08x\n", spro->dec0_inst);
-
-    fprintf(cycle_trace_fp, "dec1_active %08x\n", spro->dec1_active);
-    fprintf(cycle_trace_fp, "dec1_pc %08x\n", spro->dec1_pc);
-    fprintf(cycle_trace_fp, "dec1_inst %08x\n", spro->dec1_inst);
-    fprintf(cycle_trace_fp, "dec1_opcode %08x\n", spro->dec1_opcode);
-    fprintf(cycle_trace_fp, "dec1_src0 %08x\n", spro->dec1_src0);
-    fprintf(cycle_trace_fp, "dec1_src1 %08x\n", spro->dec1_src1);
-    fprintf(cycle_trace_fp, "dec1_dst %08x\n", spro->dec1_dst);
-    fprintf(cycle_trace_fp, "dec1_immediate %08x\n", spro->dec1_immediate);
-
-
-    fprintf(cycle_trace_fp, "exec0_active %08x\n", spro->exec0_active);
-    fprintf(cycle_trace_fp, "exec0_pc %08x\n", spro->exec0_pc);
-    fprintf(cycle_trace_fp, "exec0_inst %08x\n", spro->exec0_inst);
-    fprintf(cycle_trace_fp, "exec0_opcode %08x\n", spro->exec0_opcode);
-    fprintf(cycle_trace_fp, "exec0_src0 %08x\n", spro->exec0_src0);
-    fprintf(cycle_trace_fp, "exec0_src1 %08x\n", spro->exec0_src1);
-    fprintf(cycle_trace_fp, "exec0_dst %08x\n", spro->exec0_dst);
-    fprintf(cycle_trace_fp, "exec0_immediate %08x\n", spro->exec0_immediate);
-    fprintf(cycle_trace_fp, "exec0_alu0 %08x\n", spro->exec0_alu0);
-    fprintf(cycle_trace_fp, "exec0_alu1 %08x\n", spro->exec0_alu1);
-
-
-    fprintf(cycle_trace_fp, "exec1_active %08x\n", spro->exec1_active);
-    fprintf(cycle_trace_fp, "exec1_pc %08x\n", spro->exec1_pc);
-    fprintf(cycle_trace_fp, "exec1_inst %08x\n", spro->exec1_inst);
-    fprintf(cycle_trace_fp, "exec1_opcode %08x\n", spro->exec1_opcode);
-    fprintf(cycle_trace_fp, "exec1_src0 %08x\n", spro->exec1_src0);
-    fprintf(cycle_trace_fp, "exec1_src1 %08x\n", spro->exec1_src1);
-    fprintf(cycle_trace_fp, "exec1_dst %08x\n", spro->exec1_dst);
-    fprintf(cycle_trace_fp, "exec1_immediate %08x\n", spro->exec1_immediate);
-    fprintf(cycle_trace_fp, "exec1_alu0 %08x\n", spro->exec1_alu0);
-    fprintf(cycle_trace_fp, "exec1_alu1 %08x\n", spro->exec1_alu1);
-    fprintf(cycle_trace_fp, "exec1_aluout %08x\n", spro->exec1_aluout);
-
-
-    fprintf(cycle_trace_fp, "\n");
-    fprintf(cycle_trace_fp, "\n");
-    fprintf(cycle_trace_fp, "\n");
+        fprintf(sp->cycle_trace_fp, "r%d %08x\n", i, spro->r[0][i]);
+
+    fprintf(sp->cycle_trace_fp, "fetch0_active %08x\n", spro->fetch0_active);
+    fprintf(sp->cycle_trace_fp, "fetch0_pc %08x\n", spro->fetch0_pc);
+
+    fprintf(sp->cycle_trace_fp, "fetch1_active %08x\n", spro->fetch1_active);
+    fprintf(sp->cycle_trace_fp, "fetch1_pc %08x\n", spro->fetch1_pc);
+
+
+    fprintf(sp->cycle_trace_fp, "dec0_active %08x\n", spro->dec0_active);
+    fprintf(sp->cycle_trace_fp, "dec0_pc %08x\n", spro->dec0_pc);
+    fprintf(sp->cycle_trace_fp, "dec0_inst %08x\n", spro->dec0_inst);
+
+    fprintf(sp->cycle_trace_fp, "dec1_active %08x\n", spro->dec1_active);
+    fprintf(sp->cycle_trace_fp, "dec1_pc %08x\n", spro->dec1_pc);
+    fprintf(sp->cycle_trace_fp, "dec1_inst %08x\n", spro->dec1_inst);
+    fprintf(sp->cycle_trace_fp, "dec1_opcode %08x\n", spro->dec1_opcode);
+    fprintf(sp->cycle_trace_fp, "dec1_src0 %08x\n", spro->dec1_src0);
+    fprintf(sp->cycle_trace_fp, "dec1_src1 %08x\n", spro->dec1_src1);
+    fprintf(sp->cycle_trace_fp, "dec1_dst %08x\n", spro->dec1_dst);
+    fprintf(sp->cycle_trace_fp, "dec1_immediate %08x\n", spro->dec1_immediate);
+
+
+    fprintf(sp->cycle_trace_fp, "exec0_active %08x\n", spro->exec0_active);
+    fprintf(sp->cycle_trace_fp, "exec0_pc %08x\n", spro->exec0_pc);
+    fprintf(sp->cycle_trace_fp, "exec0_inst %08x\n", spro->exec0_inst);
+    fprintf(sp->cycle_trace_fp, "exec0_opcode %08x\n", spro->exec0_opcode);
+    fprintf(sp->cycle_trace_fp, "exec0_src0 %08x\n", spro->exec0_src0);
+    fprintf(sp->cycle_trace_fp, "exec0_src1 %08x\n", spro->exec0_src1);
+    fprintf(sp->cycle_trace_fp, "exec0_dst %08x\n", spro->exec0_dst);
+    fprintf(sp->cycle_trace_fp, "exec0_immediate %08x\n", spro->exec0_immediate);
+    fprintf(sp->cycle_trace_fp, "exec0_alu0 %08x\n", spro->exec0_alu0);
+    fprintf(sp->cycle_trace_fp, "exec0_alu1 %08x\n", spro->exec0_alu1);
+
+
+    fprintf(sp->cycle_trace_fp, "exec1_active %08x\n", spro->exec1_active);
+    fprintf(sp->cycle_trace_fp, "exec1_pc %08x\n", spro->exec1_pc);
+    fprintf(sp->cycle_trace_fp, "exec1_inst %08x\n", spro->exec1_inst);
+    fprintf(sp->cycle_trace_fp, "exec1_opcode %08x\n", spro->exec1_opcode);
+    fprintf(sp->cycle_trace_fp, "exec1_src0 %08x\n", spro->exec1_src0);
+    fprintf(sp->cycle_trace_fp, "exec1_src1 %08x\n", spro->exec1_src1);
+    fprintf(sp->cycle_trace_fp, "exec1_dst %08x\n", spro->exec1_dst);
+    fprintf(sp->cycle_trace_fp, "exec1_immediate %08x\n", spro->exec1_immediate);
+    fprintf(sp->cycle_trace_fp, "exec1_alu0 %08x\n", spro->exec1_alu0);
+    fprintf(sp->cycle_trace_fp, "exec1_alu1 %08x\n", spro->exec1_alu1);
+    fprintf(sp->cycle_trace_fp, "exec1_aluout %08x\n", spro->exec1_aluout);
+
+    for (t = 1; t < SP_NR_THREADS; t++)
+        for (i = 2; i <= 7; i++)
+            fprintf(sp->cycle_trace_fp, "t%d_r%d %08x\n", t, i, spro->r[t][i]);
+    if (SP_NR_THREADS > 1)
+        fprintf(sp->cycle_trace_fp, "threads %d %d %d %d %d %d\n", spro->fetch0_thread, spro->fetch1_thread,
+            spro->dec0_thread, spro->dec1_thread, spro->exec0_thread, spro->exec1_thread);
+
+    fprintf(sp->cycle_trace_fp, "\n");
+    fprintf(sp->cycle_trace_fp, "\n");
+    fprintf(sp->cycle_trace_fp, "\n");
 
     // Update cycle counter
     sprn->cycle_counter = spro->cycle_counter + 1;
 
+    // Multiply/divide unit write-back port
+    if (spro->mdu_busy) {
+        sprn->mdu_busy = spro->mdu_busy - 1;
+        if (spro->mdu_busy == 1 && spro->mdu_dst >= 2)
+            sprn->r[spro->mdu_thread][spro->mdu_dst] = spro->mdu_value;
+    }
+
     // ------------------------------
 // Stage EXEC1 (Write-back) — TRACE BEFORE COMMIT
 // ------------------------------
@@ -495,67 +2114,143 @@ static void sp_ctl(sp_t* sp)
         int use_ovr = 0, oA = 0, oB = 0;
         switch (spro->exec1_opcode) {
         case ADD: case SUB: case LSF: case RSF:
-        case AND: case OR:  case XOR:
+        case AND: case OR:  case XOR: case DMA_START: case DMA_DOORBELL:
+        case MUL: case DIV: case MOD: case SIMD: case LOOP:
             use_ovr = 1;
             oA = spro->exec1_alu0;   // DEC1 applied forwarding before latching into EXEC0
             oB = spro->exec1_alu1;
             break;
+        case DMA_STATUS: case CPUID:
+            use_ovr = 1;
+            oA = spro->exec1_aluout;
+            break;
+        case FAA: case CAS:
+            use_ovr = 1;
+            oA = spro->exec1_alu0;
+            oB = spro->exec1_aluout;
+            break;
+        case LDI: case STI:
+            use_ovr = 1;
+            oA = spro->exec1_alu1 & 0xFFFF;
+            oB = (spro->exec1_opcode == STI) ? spro->exec1_alu0 : sp_load_value(sp);
+            break;
+        case LD:
+            // the value came from the store buffer, not sramd
+            if (spro->exec1_sb_fwd) {
+                use_ovr = 1;
+                oB = sp_load_value(sp);
+            }
+            break;
         default:
-            break; // LD/ST/branches/LHI keep their standard trace
+            break; // ST/branches/LHI keep their standard trace
         }
 
         // TRACE (pre-commit dump) + EXEC line with operand overrides for ALU ops
-        trace_instruction(spro->exec1_inst, spro->exec1_pc, spro->r, use_ovr, oA, oB);
+        trace_instruction(sp, spro->exec1_inst, spro->exec1_pc, spro->r[spro->exec1_thread], use_ovr, oA, oB);
+        sp->thread_instructions[spro->exec1_thread]++;
+
+        // the second instruction of a fused pair sees R[dst] of the first
+        if (spro->exec1_fused) {
+            int32_t regs2[8];
+            int inst2 = spro->exec1_inst2, op2 = (inst2 >> 25) & 0x1F;
+            int first = (spro->exec1_fused == SP_FUSE_CONST) ?
+                sp_alu_result(spro->exec1_opcode, spro->exec1_alu0, spro->exec1_alu1, spro->exec1_immediate) :
+                spro->exec1_aluout;
+
+            memcpy(regs2, spro->r[spro->exec1_thread], sizeof(regs2));
+            regs2[spro->exec1_dst] = first;
+            trace_instruction(sp, inst2, (spro->exec1_pc + 1) & 0xFFFF, regs2, op2 == ADD || op2 == OR,
+                sp_fuse_operand((inst2 >> 19) & 0x07, inst2, spro->exec1_dst, first),
+                sp_fuse_operand((inst2 >> 16) & 0x07, inst2, spro->exec1_dst, first));
+            sp->thread_instructions[spro->exec1_thread]++;
+            if (spro->exec1_fused == SP_FUSE_CONST)
+                sp->fused_const++;
+            else
+                sp->fused_branch++;
+        }
 
         // Now commit results to NEXT state
         switch (spro->exec1_opcode) {
         case ADD: case SUB: case LSF: case RSF:
         case AND: case OR:  case XOR: case LHI:
+        case DMA_STATUS: case CPUID:
+        case FAA: case CAS: case SIMD:
             if (spro->exec1_dst >= 2)
-                sprn->r[spro->exec1_dst] = spro->exec1_aluout;
+                sprn->r[spro->exec1_thread][spro->exec1_dst] = spro->exec1_aluout;
+            if (spro->exec1_fused == SP_FUSE_BRANCH &&
+                sp_fused_taken(spro->exec1_inst2, spro->exec1_dst, spro->exec1_aluout))
+                sprn->r[spro->exec1_thread][7] = (spro->exec1_pc + 1) & 0xFFFF;
             break;
 
-        case LD: {
-            int wb_val = llsim_mem_extract_dataout(sp->sramd, 31, 0);
+        case LD: case LDI: {
+            int wb_val = sp_load_value(sp);
+            if (SP_LVP)
+                sp_lvp_train(sp, wb_val);
+            if ((i = sp_inc_reg(spro->exec1_opcode, spro->exec1_src1)))
+                sprn->r[spro->exec1_thread][i] = spro->exec1_alu1 + spro->exec1_immediate;
             if (spro->exec1_dst >= 2)
-                sprn->r[spro->exec1_dst] = wb_val;
+                sprn->r[spro->exec1_thread][spro->exec1_dst] = wb_val;
             break;
         }
 
-        case ST:
+        case STI:
+            if ((i = sp_inc_reg(spro->exec1_opcode, spro->exec1_src1)))
+                sprn->r[spro->exec1_thread][i] = spro->exec1_alu1 + spro->exec1_immediate;
+            break;
+
+        case ST: case LOOP:
+        case MUL: case DIV: case MOD: // written back by the unit
             break;
 
         case JLT: {
             int taken = (spro->exec1_alu0 < spro->exec1_alu1);
-            if (taken) sprn->r[7] = spro->exec1_pc;   // save FROM address
+            if (taken) sprn->r[spro->exec1_thread][7] = spro->exec1_pc;   // save FROM address
             break;
         }
         case JLE: {
             int taken = (spro->exec1_alu0 <= spro->exec1_alu1);
-            if (taken) sprn->r[7] = spro->exec1_pc;
+            if (taken) sprn->r[spro->exec1_thread][7] = spro->exec1_pc;
             break;
         }
         case JEQ: {
             int taken = (spro->exec1_alu0 == spro->exec1_alu1);
-            if (taken) sprn->r[7] = spro->exec1_pc;
+            if (taken) sprn->r[spro->exec1_thread][7] = spro->exec1_pc;
             break;
         }
         case JNE: {
             int taken = (spro->exec1_alu0 != spro->exec1_alu1);
-            if (taken) sprn->r[7] = spro->exec1_pc;
+            if (taken) sprn->r[spro->exec1_thread][7] = spro->exec1_pc;
             break;
         }
         case JIN:
             // indirect jump is always taken
-            sprn->r[7] = spro->exec1_pc;
+            sprn->r[spro->exec1_thread][7] = spro->exec1_pc;
             break;
 
 
         case HLT:
-            llsim_stop();
-            dump_sram(sp, "srami_out.txt", sp->srami);
-            dump_sram(sp, "sramd_out.txt", sp->sramd);
-            break;
+            // The thread stops here, its younger instructions never execute.
+            // The core stops with its last thread, the simulation with the
+            // last core.
+            sprn->thread_halted[spro->exec1_thread] = 1;
+            sp->thread_halt_cycle[spro->exec1_thread] = spro->cycle_counter;
+            for (t = 0; t < SP_NR_THREADS; t++)
+                if (!sprn->thread_halted[t])
+                    break;
+            if (t < SP_NR_THREADS)
+                break;
+            sprn->halted = 1;
+            sp->halt_cycle = spro->cycle_counter;
+            llsim_lock();
+            last = (++sp_halted_cores == SP_NR_CORES);
+            llsim_unlock();
+            if (last) {
+                llsim_stop();
+                dump_sram(sp, "srami_out.txt", sp_cores[0]->srami);
+                dump_sram(sp, "sramd_out.txt", sp->sramd);
+                dump_stats(sp_cores[0], "stats_out.txt");
+            }
+            return;
         }
     }
 
@@ -568,8 +2263,120 @@ static void sp_ctl(sp_t* sp)
     // The stall only prevents DEC1 -> EXEC0.
     // ------------------------------
 // -------- Stage EXEC0 (ALU/MEM) -> EXEC1 (WB) --------
-// Always advance EXEC0 to EXEC1, even on stall.
-    sprn->exec1_active = spro->exec0_active;
+// Always advance EXEC0 to EXEC1, even on stall, unless EXEC0 itself holds
+// (sramd port granted to the DMA, or a DMA command while the DMA is busy).
+    for (t = 0; t < SP_NR_THREADS; t++) {
+        sprn->event_reg[t] = sp_event(sp, t);
+        sprn->wfe_sleep[t] = spro->wfe_sleep[t] && !sp_event(sp, t);
+    }
+    sprn->dma_events = sp->dma->dmaro->events;
+    sp->exec0_stall = 0;
+    sp->wfe_park = 0;
+
+    // the load has read its value: an instruction that went on with a wrong
+    // prediction of it is dropped before it does anything
+    sp->lvp_replay = SP_LVP && spro->exec0_active && spro->exec0_lvp &&
+        spro->exec0_lvp_value != sp_load_value(sp);
+    if (sp->lvp_replay)
+        sp->lvp_replays++;
+    sprn->exec0_lvp = 0;
+
+    ex0_active = spro->exec0_active && !sprn->thread_halted[spro->exec0_thread] && !sp->lvp_replay;
+
+    // The store buffer writes its oldest line when the port is ours and EXEC0
+    // doesn't need it, or when the line can't wait
+    mine = sp_port_arbitrate(sp->dma, SP_PORT_CORE + sp->id, &grants);
+    sb_drain = sp_sb_on() && spro->sb_count && mine && (sp_sb_must_drain(sp) || !sp_core_wants_port(sp));
+    if (!sb_drain && mine && sp_core_wants_port(sp))
+        sp->port_cycles++;
+    if (sp_banked() && !mine && sp_core_wants_port(sp))
+        sp->bank_conflict_cycles++;
+    if (sp_banked() && mine && (sb_drain || sp_core_wants_port(sp)) && grants > 1)
+        sp->bank_shared_cycles++;
+    sprn->sb_age = spro->sb_count ? spro->sb_age + 1 : 0;
+    if (sb_drain)
+        sp_sb_drain(sp);
+    sp->sb_occupancy += spro->sb_count;
+    if (spro->sb_count > sp->sb_max_occupancy)
+        sp->sb_max_occupancy = spro->sb_count;
+
+    if (ex0_active && spro->exec0_opcode == WFE && !sp_sb_fence(sp)) {
+        if (sp_event(sp, spro->exec0_thread)) {
+            sprn->event_reg[spro->exec0_thread] = 0;    // consume the event and fall through
+        }
+        else if (sp_other_awake(sp, spro->exec0_thread)) {
+            // leave EXEC0 to the threads that are awake
+            sprn->wfe_sleep[spro->exec0_thread] = 1;
+            sp->wfe_park = 1;
+            ex0_active = 0;
+        }
+        else {
+            sprn->wfe_sleep[spro->exec0_thread] = 1;
+            sp->exec0_stall = 1;
+            sp->idle_cycles++;
+        }
+    }
+    if (ex0_active) {
+        if (SP_DCACHE && (sp_is_load(spro->exec0_opcode) || sp_is_store(spro->exec0_opcode))) {
+            if (sp_dcache_step(sp))
+                sp->exec0_stall = 1;
+        }
+        else if ((sp_is_load(spro->exec0_opcode) || sp_is_store(spro->exec0_opcode) ||
+            spro->exec0_opcode == FAA || spro->exec0_opcode == CAS) && !sp_sb_serves(sp) &&
+            spro->exec0_xbar_wait < sp_access_latency(spro)) {
+            sprn->exec0_xbar_wait = spro->exec0_xbar_wait + 1;
+            sp->exec0_stall = 1;
+            if (spro->exec0_xbar_wait < SP_XBAR_LATENCY) {
+                sp->xbar_cycles++;
+            }
+            else {
+                if (spro->exec0_xbar_wait == SP_XBAR_LATENCY)
+                    sp->mm_accesses++;
+                sp->mm_cycles++;
+            }
+        }
+        else if (sp_core_wants_port(sp) && !mine) {
+            sp->exec0_stall = 1;
+            sp->port_lost_cycles++;
+            if (spro->exec0_opcode == FAA || spro->exec0_opcode == CAS) {
+                llsim_lock();
+                sp_amo_stat(spro->exec0_alu1 & 0xFFFF)->wait_cycles++;
+                llsim_unlock();
+            }
+        }
+        else if (sb_drain && (sp_sb_fence(sp) || (sp_is_load(spro->exec0_opcode) && !sp_sb_serves(sp)))) {
+            // the port writes the store buffer
+            sp->exec0_stall = 1;
+        }
+        else if ((spro->exec0_opcode == FAA || spro->exec0_opcode == CAS) && spro->exec0_amo_phase == 0) {
+            // read cycle, cached copies are invalidated so nobody writes
+            // the word behind our back before the write cycle. Without the
+            // port lock (relaxed mode) the write is done right here.
+            int addr = spro->exec0_alu1 & 0xFFFF;
+            int old;
+
+            llsim_lock();
+            old = llsim_mem_extract(sp->sramd, addr, 31, 0);
+            if (sp_relaxed() && (spro->exec0_opcode == FAA || old == spro->exec0_alu2))
+                llsim_mem_inject(sp->sramd, addr, sp_amo_value(spro, old), 31, 0);
+            llsim_unlock();
+            llsim_coherence_write(sp->sramd, addr);
+            sprn->exec0_amo_old = old;
+            sprn->exec0_amo_phase = 1;
+            sp->exec0_stall = 1;
+        }
+        if ((spro->exec0_opcode == DMA_START || spro->exec0_opcode == DMA_DOORBELL) && dma_busy(sp))
+            sp->exec0_stall = 1;
+    }
+    if (sp->exec0_stall && !sprn->wfe_sleep[spro->exec0_thread])
+        sp->exec0_stall_cycles++;
+    if (ex0_active && sp_sb_fence(sp))
+        sp->sb_fence_cycles++;
+    else if (ex0_active && sp->exec0_stall && sp_is_store(spro->exec0_opcode) && sp_sb_must_drain(sp))
+        sp->sb_full_cycles++;
+
+    sprn->exec1_active = ex0_active && !sp->exec0_stall;
+    sprn->exec1_thread = spro->exec0_thread;
     sprn->exec1_pc = spro->exec0_pc;
     sprn->exec1_inst = spro->exec0_inst;
     sprn->exec1_opcode = spro->exec0_opcode;
@@ -580,8 +2387,15 @@ static void sp_ctl(sp_t* sp)
     sprn->exec1_alu0 = spro->exec0_alu0;
     sprn->exec1_alu1 = spro->exec0_alu1;
     sprn->exec1_aluout = spro->exec0_aluout; // may be overwritten below
+    sprn->exec1_fused = spro->exec0_fused;
+    sprn->exec1_inst2 = spro->exec0_inst2;
+    sprn->exec1_sb_fwd = 0;
+
+    if (ex0_active && !sp->exec0_stall) {
+        t = spro->exec0_thread;
+        if (spro->exec0_pc == spro->lp_end[t] && spro->lp_exec[t] > 0)
+            sprn->lp_exec[t] = spro->lp_exec[t] - 1;
 
-    if (spro->exec0_active) {
         switch (spro->exec0_opcode) {
         case ADD: sprn->exec1_aluout = spro->exec0_alu0 + spro->exec0_alu1; break;
         case SUB: sprn->exec1_aluout = spro->exec0_alu0 - spro->exec0_alu1; break;
@@ -594,21 +2408,122 @@ static void sp_ctl(sp_t* sp)
             sprn->exec1_aluout = (((uint32_t)spro->exec0_immediate & 0xFFFF) << 16) |
                 (spro->exec0_alu0 & 0xFFFF);
             break;
-        case LD:
+        case SIMD:
+            sprn->exec1_aluout = sp_simd_result(spro->exec0_immediate, spro->exec0_alu0, spro->exec0_alu1);
+            break;
+        case LD: case LDI:
             // Issue a proper read for address in alu1 (R[src1])
-            llsim_mem_read(sp->sramd, spro->exec0_alu1);
+            if (sp_direct_sramd()) {
+                sprn->exec1_aluout = llsim_mem_extract(sp->sramd, spro->exec0_alu1 & 0xFFFF, 31, 0);
+            }
+            else if (sp_sb_serves(sp)) {
+                i = sp_sb_find(spro, spro->exec0_alu1 & 0xFFFF);
+                sprn->exec1_aluout = spro->sb[i].data[(spro->exec0_alu1 & 0xFFFF) % SP_STORE_BUFFER_LINE_WORDS];
+                sprn->exec1_sb_fwd = 1;
+                sp->sb_forwarded++;
+            }
+            else if (sp_banked()) {
+                // other banks may be accessed this clock, go around the port
+                sprn->exec1_aluout = llsim_mem_extract(sp->sramd, spro->exec0_alu1 & 0xFFFF, 31, 0);
+            }
+            else
+                llsim_mem_read(sp->sramd, spro->exec0_alu1 & 0xFFFF);
+            llsim_prefetch_access(sp->sramd, spro->exec0_pc, spro->exec0_alu1);
             break;
 
-        case ST:
+        case ST: case STI:
             // Write R[src0] (alu0) to MEM[R[src1]] (alu1)
+            if (sp_direct_sramd()) {
+                llsim_mem_inject(sp->sramd, spro->exec0_alu1 & 0xFFFF, spro->exec0_alu0, 31, 0);
+                break;
+            }
+            if (sp_sb_on()) {
+                sp_sb_put(sp, spro->exec0_alu1 & 0xFFFF, spro->exec0_alu0);
+                break;
+            }
+            if (sp_banked()) {
+                llsim_mem_inject(sp->sramd, spro->exec0_alu1 & 0xFFFF, spro->exec0_alu0, 31, 0);
+                break;
+            }
             llsim_mem_set_datain(sp->sramd, spro->exec0_alu0, 31, 0);
-            llsim_mem_write(sp->sramd, spro->exec0_alu1);
+            llsim_mem_write(sp->sramd, spro->exec0_alu1 & 0xFFFF);
             break;
 
+        case FAA: case CAS: {
+            // write cycle of the atomic, the port is still ours
+            sp_amo_stat_t* st;
+            int old = spro->exec0_amo_old;
+            int fail = (spro->exec0_opcode == CAS && old != spro->exec0_alu2);
+
+            llsim_lock();
+            st = sp_amo_stat(spro->exec0_alu1 & 0xFFFF);
+            st->ops++;
+            if (fail)
+                st->cas_fails++;
+            llsim_unlock();
+            sprn->exec1_aluout = old;
+            if (fail || sp_relaxed())
+                break;
+            if (sp_banked()) {
+                llsim_mem_inject(sp->sramd, spro->exec0_alu1 & 0xFFFF, sp_amo_value(spro, old), 31, 0);
+                break;
+            }
+            llsim_mem_set_datain(sp->sramd, sp_amo_value(spro, old), 31, 0);
+            llsim_mem_write(sp->sramd, spro->exec0_alu1 & 0xFFFF);
+            break;
         }
 
+        case DMA_START:
+            // Latch the command, the dma unit picks it up on the next clock
+            sprn->dma_cmd = (spro->dma_cmd + 1) & 0xFF;
+            sprn->dma_chain = 0;
+            sprn->dma_src_addr = spro->exec0_alu0 & 0xFFFF;
+            sprn->dma_dst_addr = spro->exec0_alu1 & 0xFFFF;
+            sprn->dma_len = spro->exec0_immediate & 0xFFFF;
+            break;
+
+        case DMA_DOORBELL:
+            sprn->dma_cmd = (spro->dma_cmd + 1) & 0xFF;
+            sprn->dma_chain = 1;
+            sprn->dma_src_addr = spro->exec0_alu0 & 0xFFFF;
+            break;
+
+        case DMA_STATUS:
+            sprn->exec1_aluout = dma_status(sp, spro->exec0_immediate);
+            break;
+
+        case CPUID:
+            sprn->exec1_aluout = sp_cpuid(sp, spro->exec0_immediate, spro->exec0_thread);
+            break;
+
+        case LOOP:
+            t = spro->exec0_thread;
+            sprn->lp_start[t] = (spro->exec0_pc + 1) & 0xFFFF;
+            sprn->lp_end[t] = spro->exec0_immediate & 0xFFFF;
+            sprn->lp_exec[t] = (spro->exec0_alu0 > 0) ? spro->exec0_alu0 - 1 : 0;
+            break;
+
+        case MUL: case DIV: case MOD:
+            // hand the operation to the multiply/divide unit
+            sprn->exec1_aluout = sp_mdu_result(spro->exec0_opcode, spro->exec0_alu0, spro->exec0_alu1);
+            sprn->mdu_busy = (spro->exec0_opcode == MUL) ? SP_MUL_LATENCY : SP_DIV_LATENCY;
+            sprn->mdu_thread = spro->exec0_thread;
+            sprn->mdu_dst = spro->exec0_dst;
+            sprn->mdu_value = sprn->exec1_aluout;
+            sp->mdu_ops++;
+            break;
+        }
+        sprn->exec1_aluout = sp_fused_result(spro->exec0_fused, spro->exec0_inst2, spro->exec0_dst,
+            sprn->exec1_aluout);
     }
     detect_hazards(sp);
+    if (SP_LOOP_BUFFER)
+        sp_lb_lookup(sp);
+
+    // DEC1 takes its instruction from the loop buffer, FETCH0 to DEC0 wait
+    // once they hold the instructions after the loop
+    lb_stream = SP_LOOP_BUFFER && (sp->lb_hit || (spro->lb_stream && !sp_squashed(sp, 0)));
+    lb_hold = lb_stream && spro->dec0_active && !sp_squashed(sp, spro->dec0_thread);
 
     /* Note: The stall handling that prevents DEC1 -> EXEC0 should be in the DEC1 block.
        Do NOT zero exec1 on stall; otherwise you’ll “skip” the instruction already in EXEC0. */
@@ -618,11 +2533,12 @@ static void sp_ctl(sp_t* sp)
        // Stage DEC1 (operand prep → EXEC0 latch)
        // ------------------------------
     if (!sp->stall) {
-        if (sp->flush) {
+        if (sp_squashed(sp, spro->dec1_thread)) {
             sprn->exec0_active = 0;
         }
         else {
             sprn->exec0_active = spro->dec1_active;
+            sprn->exec0_thread = spro->dec1_thread;
             sprn->exec0_pc = spro->dec1_pc;
             sprn->exec0_inst = spro->dec1_inst;
             sprn->exec0_opcode = spro->dec1_opcode;
@@ -630,15 +2546,27 @@ static void sp_ctl(sp_t* sp)
             sprn->exec0_src1 = spro->dec1_src1;
             sprn->exec0_dst = spro->dec1_dst;
             sprn->exec0_immediate = spro->dec1_immediate;
+            sprn->exec0_fused = spro->dec1_fused;
+            sprn->exec0_inst2 = spro->dec1_inst2;
+            sprn->exec0_redirected = spro->dec1_redirected;
+            sprn->exec0_lvp = sp->lvp_forward;
+            sprn->exec0_lvp_value = sp->lvp_value;
+            if (sp->lvp_forward && spro->dec1_active)
+                sp->lvp_used++;
+            sprn->exec0_xbar_wait = 0;
+            sprn->exec0_dc_state = SP_DC_PROBE;
+            sprn->exec0_amo_phase = 0;
+            if (SP_LOOP_BUFFER && spro->dec1_active)
+                sp_lb_capture(sp);
 
             // Build fresh operands now (AFTER write-back of prior cycle and AFTER detect_hazards)
             int a0 = (spro->dec1_src0 == 0) ? 0 :
                 (spro->dec1_src0 == 1) ? spro->dec1_immediate :
-                spro->r[spro->dec1_src0];
+                spro->r[spro->dec1_thread][spro->dec1_src0];
 
             int a1 = (spro->dec1_src1 == 0) ? 0 :
                 (spro->dec1_src1 == 1) ? spro->dec1_immediate :
-                spro->r[spro->dec1_src1];
+                spro->r[spro->dec1_thread][spro->dec1_src1];
 
             // Apply existing forwarding decisions (already computed in detect_hazards)
             if (sp->forward_alu0) {
@@ -653,10 +2581,14 @@ static void sp_ctl(sp_t* sp)
             sprn->exec0_alu0 = a0;
             sprn->exec0_alu1 = a1;
 
+            // CAS also reads its expected value from R[dst]
+            sprn->exec0_alu2 = sp->forward_alu2 ? sp->forward_value_alu2 :
+                (spro->dec1_dst >= 2) ? spro->r[spro->dec1_thread][spro->dec1_dst] : 0;
+
 
         }
     }
-    else {
+    else if (!sp->exec0_stall) {
         sprn->exec0_active = 0;
     }
 
@@ -665,11 +2597,23 @@ static void sp_ctl(sp_t* sp)
     // Stage DEC0 (decode + build operands)
     // ------------------------------
     if (!sp->stall) {
-        if (sp->flush) {
+        if (lb_stream) {
+            sp_lb_stream(sp);
+        }
+        else if (sp_squashed(sp, spro->dec0_thread)) {
             sprn->dec1_active = 0;
+            sprn->lb_stream = 0;
+            sprn->lb_refill = 0;
         }
         else {
+            if (spro->lb_refill) {
+                if (spro->dec0_active)
+                    sprn->lb_refill = 0;
+                else
+                    sp->lb_refill_bubbles++;
+            }
             sprn->dec1_active = spro->dec0_active;
+            sprn->dec1_thread = spro->dec0_thread;
             sprn->dec1_pc = spro->dec0_pc;
             sprn->dec1_inst = spro->dec0_inst;
 
@@ -681,25 +2625,25 @@ static void sp_ctl(sp_t* sp)
                 sprn->dec1_immediate = (int16_t)(spro->dec0_inst & 0xFFFF);
 
                 switch (sprn->dec1_opcode) {
-                case LD:
+                case LD: case LDI:
                     // address from R[src1]
                     sprn->dec1_alu0 = 0;                               // unused
-                    sprn->dec1_alu1 = spro->r[sprn->dec1_src1];        // <-- r2 here (may be stale; will be forwarded)
+                    sprn->dec1_alu1 = spro->r[spro->dec0_thread][sprn->dec1_src1];        // <-- r2 here (may be stale; will be forwarded)
                     break;
 
-                case ST:
+                case ST: case STI:
                     // data = R[src0], address = R[src1]
-                    sprn->dec1_alu0 = spro->r[sprn->dec1_src0];        // data
-                    sprn->dec1_alu1 = spro->r[sprn->dec1_src1];        // address
+                    sprn->dec1_alu0 = spro->r[spro->dec0_thread][sprn->dec1_src0];        // data
+                    sprn->dec1_alu1 = spro->r[spro->dec0_thread][sprn->dec1_src1];        // address
                     break;
 
                 case JLT: case JLE: case JEQ: case JNE:
-                    sprn->dec1_alu0 = spro->r[sprn->dec1_src0];
-                    sprn->dec1_alu1 = spro->r[sprn->dec1_src1];
+                    sprn->dec1_alu0 = spro->r[spro->dec0_thread][sprn->dec1_src0];
+                    sprn->dec1_alu1 = spro->r[spro->dec0_thread][sprn->dec1_src1];
                     break;
 
                 case JIN:
-                    sprn->dec1_alu0 = spro->r[sprn->dec1_dst];
+                    sprn->dec1_alu0 = spro->r[spro->dec0_thread][sprn->dec1_dst];
                     sprn->dec1_alu1 = 0;
                     break;
 
@@ -707,13 +2651,37 @@ static void sp_ctl(sp_t* sp)
                     // ALU ops: src==1 means “use immediate”
                     sprn->dec1_alu0 = (sprn->dec1_src0 == 0) ? 0 :
                         (sprn->dec1_src0 == 1) ? sprn->dec1_immediate :
-                        spro->r[sprn->dec1_src0];
+                        spro->r[spro->dec0_thread][sprn->dec1_src0];
                     sprn->dec1_alu1 = (sprn->dec1_src1 == 0) ? 0 :
                         (sprn->dec1_src1 == 1) ? sprn->dec1_immediate :
-                        spro->r[sprn->dec1_src1];
+                        spro->r[spro->dec0_thread][sprn->dec1_src1];
                     break;
                 }
             }
+
+            // fuse with the next instruction of the thread, unless it ends
+            // the hardware loop (EXEC0 counts the back-edges by its pc)
+            sprn->dec1_fused = SP_FUSE_NONE;
+            if (SP_FUSION && spro->dec0_active && spro->fetch1_active &&
+                spro->fetch1_thread == spro->dec0_thread &&
+                spro->fetch1_pc == ((spro->dec0_pc + 1) & 0xFFFF) &&
+                spro->fetch1_pc != spro->lp_end[spro->dec0_thread]) {
+                sprn->dec1_fused = sp_fuse_kind(spro->dec0_inst, spro->fetch1_inst);
+                sprn->dec1_inst2 = spro->fetch1_inst;
+                fused = (sprn->dec1_fused != SP_FUSE_NONE);
+            }
+
+            // an always-taken jump sends FETCH0 to its target right away
+            sprn->dec1_redirected = 0;
+            if (SP_DEC0_REDIRECT && spro->dec0_active &&
+                (sprn->dec1_opcode == JEQ || sprn->dec1_opcode == JLE) &&
+                sprn->dec1_src0 == sprn->dec1_src1 &&
+                !spro->lp_fetch[spro->dec0_thread] && !spro->lp_exec[spro->dec0_thread]) {
+                sp->dec0_redirect = 1;
+                sp->dec0_target = spro->dec0_inst & 0xFFFF;
+                sprn->dec1_redirected = 1;
+                sp->dec0_redirects++;
+            }
         }
     }
 
@@ -721,49 +2689,70 @@ static void sp_ctl(sp_t* sp)
     // ------------------------------
     // Stage FETCH1 (sample inst)
     // ------------------------------
-    if (!sp->stall) {
-        if (sp->flush) {
+    if (!sp->stall && !lb_hold) {
+        if (sp_squashed(sp, spro->fetch1_thread) || fused ||
+            (sp->dec0_redirect && spro->fetch1_thread == spro->dec0_thread)) {
             sprn->dec0_active = 0;
         }
         else {
             sprn->dec0_active = spro->fetch1_active;
+            sprn->dec0_thread = spro->fetch1_thread;
             sprn->dec0_pc = spro->fetch1_pc;
             sprn->dec0_inst = spro->fetch1_inst;
         }
     }
     else {
-        // Stall: keep DEC0 latched
+        // Stall (or the loop buffer streaming): keep DEC0 latched
         sprn->dec0_active = spro->dec0_active;
         sprn->dec0_pc = spro->dec0_pc;
         sprn->dec0_inst = spro->dec0_inst;
     }
 
+    // A branch leaving the hardware loop ends it, one inside restarts the
+    // count where EXEC0 has got to
+    if (sp->branch_taken) {
+        t = spro->exec0_thread;
+        if (sp->branch_target >= sprn->lp_start[t] && sp->branch_target <= sprn->lp_end[t])
+            sprn->lp_fetch[t] = sprn->lp_exec[t];
+        else
+            sprn->lp_fetch[t] = sprn->lp_exec[t] = 0;
+    }
+
     // ------------------------------
     // Stage FETCH0 (issue fetch)
     // ------------------------------
-    if (!sp->stall) {
-        if (sp->flush) {
+    if (!sp->stall && !lb_hold) {
+        if (sp_squashed(sp, spro->fetch0_thread) ||
+            (sp->dec0_redirect && spro->fetch0_thread == spro->dec0_thread)) {
             sprn->fetch1_active = 0;
         }
         else {
             sprn->fetch1_active = spro->fetch0_active;
+            sprn->fetch1_thread = spro->fetch0_thread;
             sprn->fetch1_pc = spro->fetch0_pc;
 
             if (spro->fetch0_active) {
                 sprn->fetch1_inst = llsim_mem_extract(sp->srami, spro->fetch0_pc, 31, 0);
+                llsim_prefetch_access(sp->srami, spro->fetch0_pc, spro->fetch0_pc);
             }
         }
 
-        // Next PC
+        // Next PC of every thread, FETCH0 goes on with one of them
         int next_pc;
-        if (spro->fetch0_active) {
-            next_pc = sp->branch_taken ? sp->branch_target : (spro->fetch0_pc + 1);
-        }
-        else {
-            next_pc = 0;  // Start from PC=0 if not active
+        for (t = 0; t < SP_NR_THREADS; t++) {
+            sprn->thread_pc[t] = sp_thread_next_pc(sp, t);
+            if (sp_loop_back(sp, t)) {
+                sprn->lp_fetch[t] = spro->lp_fetch[t] - 1;
+                sp->loop_back_edges++;
+            }
         }
+        t = sp_next_thread(sp);
+        next_pc = sprn->thread_pc[t];
+        sprn->fetch_thread = t;
+        sprn->mt_switch = 0;
 
         sprn->fetch0_active = 1;
+        sprn->fetch0_thread = t;
         sprn->fetch0_pc = next_pc;
 
         // Issue read for next instruction
@@ -778,27 +2767,26 @@ static void sp_ctl(sp_t* sp)
         }
     }
     else {
-        // Stall: keep FETCH state
+        // Stall (or the loop buffer streaming): keep FETCH state
         sprn->fetch1_active = spro->fetch1_active;
         sprn->fetch1_pc = spro->fetch1_pc;
         sprn->fetch1_inst = spro->fetch1_inst;
         sprn->fetch0_active = spro->fetch0_active;
         sprn->fetch0_pc = spro->fetch0_pc;
-    }
+        sprn->mt_switch = 1;
 
-    // ------------------------------
-    // DMA (unchanged)
-    // ------------------------------
-    if (spro->dma_busy && !spro->dma_done) {
-        if (spro->dma_counter < spro->dma_len) {
-            int data = llsim_mem_extract(sp->sramd, spro->dma_src_addr + spro->dma_counter, 31, 0);
-            llsim_mem_inject(sp->sramd, spro->dma_dst_addr + spro->dma_counter, data, 31, 0);
-            sprn->dma_counter = spro->dma_counter + 1;
-        }
-        else {
-            sprn->dma_done = 1;
-            sprn->dma_busy = 0;
-        }
+        // a thread flushed behind the stall drops what it holds and
+        // fetches from its branch target once the stall clears
+        if (sp_squashed(sp, spro->dec1_thread))
+            sprn->dec1_active = 0;
+        if (sp_squashed(sp, spro->dec0_thread))
+            sprn->dec0_active = 0;
+        if (sp_squashed(sp, spro->fetch1_thread))
+            sprn->fetch1_active = 0;
+        if (sp_squashed(sp, spro->fetch0_thread))
+            sprn->fetch0_active = 0;
+        if (sp->branch_taken)
+            sprn->thread_pc[spro->exec0_thread] = sp->branch_target;
     }
 
     // ------------------------------
@@ -807,8 +2795,8 @@ static void sp_ctl(sp_t* sp)
 
 
     sp_printf("cycle_counter %08x\n", spro->cycle_counter);
-    sp_printf("r2 %08x, r3 %08x\n", spro->r[2], spro->r[3]);
-    sp_printf("r4 %08x, r5 %08x, r6 %08x, r7 %08x\n", spro->r[4], spro->r[5], spro->r[6], spro->r[7]);
+    sp_printf("r2 %08x, r3 %08x\n", spro->r[0][2], spro->r[0][3]);
+    sp_printf("r4 %08x, r5 %08x, r6 %08x, r7 %08x\n", spro->r[0][4], spro->r[0][5], spro->r[0][6], spro->r[0][7]);
     sp_printf("fetch0_active %d, fetch1_active %d, dec0_active %d, dec1_active %d, exec0_active %d, exec1_active %d\n",
         spro->fetch0_active, spro->fetch1_active, spro->dec0_active, spro->dec1_active, spro->exec0_active, spro->exec1_active);
     sp_printf("fetch0_pc %d, fetch1_pc %d, dec0_pc %d, dec1_pc %d, exec0_pc %d, exec1_pc %d\n",
@@ -824,14 +2812,282 @@ static void sp_run(llsim_unit_t* unit)
         return;
     }
 
+    if (sp->spro->halted)
+        return;
+
+    // sramd is shared, the kernel clears its port after every clock
     sp->srami->read = 0;
     sp->srami->write = 0;
-    sp->sramd->read = 0;
-    sp->sramd->write = 0;
 
     sp_ctl(sp);
 }
 
+// Current block finished: follow the chain or raise the completion flag
+static void dma_next_descriptor(dma_t* dma)
+{
+    dma_registers_t* dmarn = dma->dmarn;
+
+    if (dmarn->next) {
+        dmarn->desc_addr = dmarn->next;
+        dmarn->desc_word = 0;
+        dmarn->next = 0;
+        dmarn->state = DMA_STATE_DESC;
+    }
+    else {
+        dmarn->done = 1;
+        dmarn->events = (dma->dmaro->events + 1) & 0xFF;
+        dmarn->state = DMA_STATE_IDLE;
+    }
+}
+
+// Start moving a block, reading main memory has to fill the pipeline first
+static void dma_start_block(dma_t* dma)
+{
+    dma_registers_t* dmarn = dma->dmarn;
+
+    dmarn->state = DMA_STATE_READ;
+    if (sp_main_mem(dmarn->src) && SP_MAIN_MEM_LATENCY) {
+        dmarn->state = DMA_STATE_MM;
+        dmarn->mm_wait = SP_MAIN_MEM_LATENCY;
+        dmarn->mm_end = 0;
+    }
+}
+
+static void dma_ctl(dma_t* dma)
+{
+    dma_registers_t* dmaro = dma->dmaro;
+    dma_registers_t* dmarn = dma->dmarn;
+    sp_t* cmd = dma_command();
+    llsim_memory_t* sramd = dma->sp->sramd;
+    int mine, grants, i, id;
+
+    mine = sp_port_arbitrate(dma, SP_PORT_DMA, &grants);
+    for (i = 1; i <= SP_NR_CORES; i++) {
+        id = (dmaro->core_last + i) % SP_NR_CORES;
+        if (sp_port_granted(dma, SP_PORT_CORE + id))
+            dmarn->core_last = id;
+    }
+    if (dma_wants_port(dma) && dma_contended(dma)) {
+        if (mine)
+            dma->stolen_cycles++;
+        else
+            dma->stalled_cycles++;
+        dmarn->arb_last = mine ? SP_PORT_DMA : SP_PORT_CORE + dmarn->core_last;
+    }
+    if (mine && dma_wants_port(dma)) {
+        dma->port_cycles++;
+        if (grants > 1)
+            dma->bank_shared_cycles++;
+    }
+    if (dmaro->state != DMA_STATE_IDLE)
+        dma->busy_cycles++;
+
+    switch (dmaro->state) {
+    case DMA_STATE_IDLE:
+        if (!cmd)
+            break;
+        dmarn->cmd_taken[cmd->id] = cmd->spro->dma_cmd;
+        dmarn->done = 0;
+        dmarn->next = 0;
+        if (cmd->spro->dma_chain) {
+            dmarn->desc_addr = cmd->spro->dma_src_addr;
+            dmarn->desc_word = 0;
+            dmarn->state = DMA_STATE_DESC;
+        }
+        else if (cmd->spro->dma_len > 0) {
+            dmarn->src = cmd->spro->dma_src_addr;
+            dmarn->dst = cmd->spro->dma_dst_addr;
+            dmarn->remaining = cmd->spro->dma_len;
+            dmarn->src_stride = 1;
+            dmarn->dst_stride = 1;
+            dma_start_block(dma);
+        }
+        else {
+            dmarn->done = 1;
+            dmarn->events = (dmaro->events + 1) & 0xFF;
+        }
+        break;
+
+    case DMA_STATE_DESC: {
+        int w;
+
+        if (!mine)
+            break;
+        w = llsim_mem_extract(sramd, (dmaro->desc_addr + dmaro->desc_word) & 0xFFFF, 31, 0);
+        switch (dmaro->desc_word) {
+        case 0: dmarn->src = w & 0xFFFF; break;
+        case 1: dmarn->dst = w & 0xFFFF; break;
+        case 2: dmarn->remaining = w & 0xFFFF; break;
+        case 3:
+            dmarn->src_stride = (w & 0xFFFF) ? (w & 0xFFFF) : 1;
+            dmarn->dst_stride = ((w >> 16) & 0xFFFF) ? ((w >> 16) & 0xFFFF) : 1;
+            break;
+        case 4: dmarn->next = w & 0xFFFF; break;
+        }
+        dmarn->desc_word = dmaro->desc_word + 1;
+        if (dmarn->desc_word == DMA_DESC_WORDS) {
+            dma->descriptors++;
+            if (dmarn->remaining)
+                dma_start_block(dma);
+            else
+                dma_next_descriptor(dma);
+        }
+        break;
+    }
+
+    case DMA_STATE_READ:
+        if (!mine)
+            break;
+        dmarn->burst = dma_next_burst(dmaro);
+        for (i = 0; i < dmarn->burst; i++)
+            dmarn->buf[i] = llsim_mem_extract(sramd, (dmaro->src + i * dmaro->src_stride) & 0xFFFF, 31, 0);
+        dmarn->state = DMA_STATE_WRITE;
+        break;
+
+    case DMA_STATE_WRITE:
+        if (!mine)
+            break;
+        for (i = 0; i < dmaro->burst; i++) {
+            llsim_mem_inject(sramd, (dmaro->dst + i * dmaro->dst_stride) & 0xFFFF, dmaro->buf[i], 31, 0);
+            llsim_coherence_write(sramd, (dmaro->dst + i * dmaro->dst_stride) & 0xFFFF);
+        }
+        dmarn->src = dmaro->src + dmaro->burst * dmaro->src_stride;
+        dmarn->dst = dmaro->dst + dmaro->burst * dmaro->dst_stride;
+        dmarn->remaining = dmaro->remaining - dmaro->burst;
+        dma->words += dmaro->burst;
+        if (dmarn->remaining) {
+            dmarn->state = DMA_STATE_READ;
+        }
+        else if (sp_main_mem(dmaro->dst) && SP_MAIN_MEM_LATENCY) {
+            // the last words are still on their way to main memory
+            dmarn->state = DMA_STATE_MM;
+            dmarn->mm_wait = SP_MAIN_MEM_LATENCY;
+            dmarn->mm_end = 1;
+        }
+        else {
+            dma_next_descriptor(dma);
+        }
+        break;
+
+    case DMA_STATE_MM:
+        dma->mm_cycles++;
+        if (dmaro->mm_wait > 1)
+            dmarn->mm_wait = dmaro->mm_wait - 1;
+        else if (dmaro->mm_end)
+            dma_next_descriptor(dma);
+        else
+            dmarn->state = DMA_STATE_READ;
+        break;
+    }
+}
+
+static void dma_run(llsim_unit_t* unit)
+{
+    dma_t* dma = (dma_t*)unit->private;
+
+    if (llsim->reset) {
+        memset(dma->dmarn, 0, sizeof(*dma->dmarn));
+        return;
+    }
+
+    dma_ctl(dma);
+}
+
+// A block copy proceeds on its own as long as the core leaves the port
+// alone; stop one clock short of the cycle that completes the block.
+static int dma_quiescent(llsim_unit_t* unit)
+{
+    dma_t* dma = (dma_t*)unit->private;
+    dma_registers_t* dmaro = dma->dmaro;
+    int burst, bursts;
+
+    switch (dmaro->state) {
+    case DMA_STATE_IDLE:
+        return dma_command() ? 0 : LLSIM_FOREVER;
+    case DMA_STATE_READ:
+    case DMA_STATE_WRITE:
+        burst = (dmaro->src_stride == 1 && dmaro->dst_stride == 1) ? SP_DMA_BURST_WORDS : 1;
+        bursts = (dmaro->remaining + burst - 1) / burst;
+        return 2 * bursts - (dmaro->state == DMA_STATE_WRITE) - 1;
+    default:
+        return 0;
+    }
+}
+
+static void dma_skip(llsim_unit_t* unit, int clocks)
+{
+    dma_t* dma = (dma_t*)unit->private;
+
+    if (dma->dmaro->state == DMA_STATE_IDLE)
+        return;
+    while (clocks--) {
+        dma_ctl(dma);
+        memcpy(dma->dmaro, dma->dmarn, sizeof(dma_registers_t));
+    }
+}
+
+static void dma_init(sp_t* sp)
+{
+    llsim_unit_t* llsim_dma_unit;
+    llsim_unit_registers_t* llsim_ur;
+    dma_t* dma;
+    char name[32];
+    int i, j;
+
+    llsim_printf("initializing dma unit\n");
+
+    llsim_dma_unit = llsim_register_unit("dma", dma_run);
+    llsim_dma_unit->quiescent = dma_quiescent;
+    llsim_dma_unit->skip = dma_skip;
+    llsim_ur = llsim_allocate_registers(llsim_dma_unit, "dma_registers", sizeof(dma_registers_t));
+    dma = llsim_malloc(sizeof(dma_t));
+    llsim_dma_unit->private = dma;
+    dma->dmaro = llsim_ur->old;
+    dma->dmarn = llsim_ur->new;
+    dma->sp = sp;
+    for (i = 0; i < SP_NR_CORES; i++)
+        sp_cores[i]->dma = dma;
+
+    // drives the ports of sramd, which belongs to core 0
+    llsim_dma_unit->affinity = llsim_find_unit("sp");
+
+    llsim_dma_unit->event_driven = 1;
+    for (i = 0; i < SP_NR_CORES; i++)
+        for (j = 0; j < SP_NR_DMA_PORTS; j++) {
+            sprintf(name, "%s_%d", sp_dma_ports[j].name, i);
+            llsim_register_input("dma", name, sp_dma_ports[j].bits,
+                (char*)sp_cores[i]->spro + sp_dma_ports[j].offset,
+                (char*)sp_cores[i]->sprn + sp_dma_ports[j].offset);
+        }
+}
+
+// Every thread asleep in WFE with nothing in flight (the multiply/divide unit
+// counts down every clock): quiescent until an event arrives
+static int sp_quiescent(llsim_unit_t* unit)
+{
+    sp_t* sp = (sp_t*)unit->private;
+    sp_registers_t* spro = sp->spro;
+
+    if (spro->halted)
+        return LLSIM_FOREVER;
+    if (sp_asleep(sp) && !spro->exec1_active && !spro->mdu_busy)
+        return LLSIM_FOREVER;
+    return 0;
+}
+
+static void sp_skip(llsim_unit_t* unit, int clocks)
+{
+    sp_t* sp = (sp_t*)unit->private;
+
+    if (sp->spro->halted)
+        return;
+    fprintf(sp->cycle_trace_fp, "cycle %d-%d idle (skipped)\n\n\n\n",
+        sp->spro->cycle_counter, sp->spro->cycle_counter + clocks - 1);
+    sp->spro->cycle_counter += clocks;
+    sp->sprn->cycle_counter = sp->spro->cycle_counter;
+    sp->idle_cycles += clocks;
+}
+
 static void sp_generate_sram_memory_image(sp_t* sp, char* program_name)
 {
     FILE* fp;
@@ -851,53 +3107,97 @@ static void sp_generate_sram_memory_image(sp_t* sp, char* program_name)
     }
     sp->memory_image_size = addr;
 
-    fprintf(inst_trace_fp, "program %s loaded, %d lines\n\n", program_name, addr);
+    fprintf(sp->inst_trace_fp, "program %s loaded, %d lines\n\n", program_name, addr);
 
     for (i = 0; i < sp->memory_image_size; i++) {
         llsim_mem_inject(sp->srami, i, sp->memory_image[i], 31, 0);
         // Initialize data memory with the same content for simplicity
-        llsim_mem_inject(sp->sramd, i, sp->memory_image[i], 31, 0);
+        if (sp->id == 0)
+            llsim_mem_inject(sp->sramd, i, sp->memory_image[i], 31, 0);
     }
 }
 
-void sp_init(char* program_name)
+// Core 0 keeps the single-core unit and trace file names, core i gets an
+// "_i" suffix. Core 0 also owns the shared sramd.
+static sp_t* sp_core_init(int id, char* program_name)
 {
     llsim_unit_t* llsim_sp_unit;
     llsim_unit_registers_t* llsim_ur;
     sp_t* sp;
+    char name[32], suffix[16];
+    int i;
+
+    if (id)
+        sprintf(suffix, "_%d", id);
+    else
+        suffix[0] = 0;
+
+    llsim_printf("initializing sp%s unit\n", suffix);
 
-    llsim_printf("initializing sp unit\n");
+    sp = llsim_malloc(sizeof(sp_t));
+    sp->id = id;
 
-    inst_trace_fp = fopen("inst_trace.txt", "w");
-    if (inst_trace_fp == NULL) {
-        printf("couldn't open file inst_trace.txt\n");
+    sprintf(name, "inst_trace%s.txt", suffix);
+    sp->inst_trace_fp = fopen(name, "w");
+    if (sp->inst_trace_fp == NULL) {
+        printf("couldn't open file %s\n", name);
         exit(1);
     }
 
-    cycle_trace_fp = fopen("cycle_trace.txt", "w");
-    if (cycle_trace_fp == NULL) {
-        printf("couldn't open file cycle_trace.txt\n");
+    sprintf(name, "cycle_trace%s.txt", suffix);
+    sp->cycle_trace_fp = fopen(name, "w");
+    if (sp->cycle_trace_fp == NULL) {
+        printf("couldn't open file %s\n", name);
         exit(1);
     }
 
-    llsim_sp_unit = llsim_register_unit("sp", sp_run);
+    sprintf(name, "sp%s", suffix);
+    llsim_sp_unit = llsim_register_unit(name, sp_run);
+    llsim_sp_unit->quiescent = sp_quiescent;
+    llsim_sp_unit->skip = sp_skip;
     llsim_ur = llsim_allocate_registers(llsim_sp_unit, "sp_registers", sizeof(sp_registers_t));
-    sp = llsim_malloc(sizeof(sp_t));
     llsim_sp_unit->private = sp;
     sp->spro = llsim_ur->old;
     sp->sprn = llsim_ur->new;
 
+    // only a halted core stops changing its registers, and it ignores the
+    // other units from then on
+    llsim_sp_unit->event_driven = 1;
+    for (i = 0; i < SP_NR_DMA_PORTS; i++)
+        llsim_register_output(name, sp_dma_ports[i].name, sp_dma_ports[i].bits,
+            (char*)sp->spro + sp_dma_ports[i].offset, (char*)sp->sprn + sp_dma_ports[i].offset);
+
     sp->srami = llsim_allocate_memory(llsim_sp_unit, "srami", 32, SP_SRAM_HEIGHT, 0);
-    sp->sramd = llsim_allocate_memory(llsim_sp_unit, "sramd", 32, SP_SRAM_HEIGHT, 0);
+    if (id == 0)
+        sp->sramd = llsim_allocate_memory(llsim_sp_unit, "sramd", 32, SP_SRAM_HEIGHT, 0);
+    else
+        sp->sramd = sp_cores[0]->sramd;
     sp_generate_sram_memory_image(sp, program_name);
 
+    if (SP_DCACHE) {
+        sprintf(name, "dcache%s", suffix);
+        sp->dcache = llsim_allocate_cache(sp->sramd, name, SP_DCACHE_LINES, SP_DCACHE_LINE_WORDS);
+    }
+
+    if (SP_PREFETCH) {
+        llsim_allocate_prefetcher(sp->srami, "next_line", llsim_pf_next_line_train,
+            SP_PREFETCH_LINE_WORDS, SP_PREFETCH_DEGREE, SP_PREFETCH_DISTANCE, SP_PREFETCH_LATENCY);
+        if (id == 0)
+            llsim_allocate_prefetcher(sp->sramd, "stride", llsim_pf_stride_train,
+                SP_PREFETCH_LINE_WORDS, SP_PREFETCH_DEGREE, SP_PREFETCH_DISTANCE, SP_PREFETCH_LATENCY);
+    }
+
     sp->start = 1;
 
-    // Initialize DMA registers
-    sp->sprn->dma_busy = 0;
-    sp->sprn->dma_done = 0;
-    sp->sprn->dma_src_addr = 0;
-    sp->sprn->dma_dst_addr = 0;
-    sp->sprn->dma_counter = 0;
-    sp->sprn->dma_len = 0;
+    return sp;
+}
+
+void sp_init(char* program_name)
+{
+    int i;
+
+    for (i = 0; i < SP_NR_CORES; i++)
+        sp_cores[i] = sp_core_init(i, program_name);
+
+    dma_init(sp_cores[0]);
 }